@@ -6,9 +6,21 @@
  * i w pętli tworzy nowych pacjentów (fork + execl pacjent).
  * Respektuje limit max_patients z SharedState.
  * Obsługuje SIGTERM — czyste zamknięcie z zebraniem procesów potomnych.
+ * Drenaż (SharedState::draining): koniec przyjęć, czekanie aż obecni pacjenci
+ * zakończą wizytę, potem wyjście — dyrektor wykrywa to przez pidfd.
+ *
+ * Źródła napływu (wybór przez dyrektora):
+ * - domyślnie: odstęp losowy z [min_ms, max_ms]
+ * - -T plik: ślad przyjęć "czas_ms wiek vip" odtwarzany strumieniowo z pliku mapowanego
+ * - -R plik: profil "od_s pacjentów_na_s" — niejednorodny proces Poissona,
+ *   intensywność stała w przedziałach
+ * - SharedState::gen_rate > 0: proces Poissona o intensywności zmienianej przez
+ *   dyrektora (wyszukiwanie punktu nasycenia, -S) — ma pierwszeństwo
  */
 
 #include "sor_common.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // ============================================================================
 // ZMIENNE GLOBALNE GENERATORA
@@ -41,9 +53,19 @@ static void sigchldHandler(int sig) {
 
 /**
  * @brief Loguje pojawienie się pacjenta, przydziela bilety FIFO, fork+execl pacjent.
+ * @param age wiek z śladu przyjęć lub -1 = losuj wiek i VIP ze strumienia pacjenta
  * @return PID dziecka (>0) lub -1 jeśli fork się nie powiódł.
  */
 static pid_t spawnPatient(SharedState* state, int semid, int patient_id, int age, int is_vip) {
+    // Atrybuty zależą tylko od ziarna i numeru pacjenta, nie od chwili przyjęcia
+    RngScope rng(RNG_ROLE_PATIENT, (uint32_t)patient_id);
+    if (age < 0) {
+        age = randomAge();
+        is_vip = randomVIP() ? 1 : 0;
+    }
+    // Syntetyczna tożsamość z ograniczonej puli — ci sami pacjenci wracają (rejestr)
+    unsigned long long identity = (unsigned long long)randomInt(1, REGISTRY_POPULATION);
+
     // Loguj pojawienie się
     if (age < 18) {
         logMessage(state, semid, "Pacjent %d pojawia się przed SOR (wiek %d, z opiekunem)",
@@ -67,18 +89,15 @@ static pid_t spawnPatient(SharedState* state, int semid, int patient_id, int age
         // Dziecko — gdy generator umrze, kernel wyśle SIGTERM
         prctl(PR_SET_PDEATHSIG, SIGTERM);
 
-        char id_str[16], age_str[16], vip_str[16], t1_str[16], t2_str[16];
+        char id_str[16], age_str[16], vip_str[16], t1_str[16], t2_str[16], ident_str[24];
         snprintf(id_str, sizeof(id_str), "%d", patient_id);
         snprintf(age_str, sizeof(age_str), "%d", age);
         snprintf(vip_str, sizeof(vip_str), "%d", is_vip);
         snprintf(t1_str, sizeof(t1_str), "%ld", ticket1);
+        snprintf(t2_str, sizeof(t2_str), "%ld", ticket2);  // 0 = dorosły (brak drugiego miejsca)
+        snprintf(ident_str, sizeof(ident_str), "%llu", identity);
 
-        if (age < 18) {
-            snprintf(t2_str, sizeof(t2_str), "%ld", ticket2);
-            execl("./pacjent", "pacjent", id_str, age_str, vip_str, t1_str, t2_str, nullptr);
-        } else {
-            execl("./pacjent", "pacjent", id_str, age_str, vip_str, t1_str, nullptr);
-        }
+        execl("./pacjent", "pacjent", id_str, age_str, vip_str, t1_str, t2_str, ident_str, nullptr);
         // execl nie wraca jeśli się powiodło — tu dotrzemy tylko przy błędzie
         SOR_FATAL("execl pacjent id=%d", patient_id);
 
@@ -89,11 +108,262 @@ static pid_t spawnPatient(SharedState* state, int semid, int patient_id, int age
         semWait(semid, SEM_SHM_MUTEX);
         if (state->active_patient_count > 0) state->active_patient_count--;
         semSignal(semid, SEM_SHM_MUTEX);
+        if (state->max_patients > 0) semSignal(semid, SEM_ADMISSION);
     }
 
     return pid;
 }
 
+/// Czy generator może przyjmować nowych pacjentów
+static inline bool admissionsOpen(SharedState* state) {
+    return !state->shutdown && !state->draining && !g_gen_shutdown;
+}
+
+// ============================================================================
+// KONTROLA PRZYJĘĆ — miejsca (-p) i wiadro żetonów (-b)
+// ============================================================================
+
+/**
+ * @brief Zajmuje miejsce na proces pacjenta (SEM_ADMISSION) — blokuje bez odpytywania
+ *
+ * Semafor zwalnia exitSOR pacjenta (albo spawnPatient przy nieudanym fork).
+ * SIGTERM (bez SA_RESTART) przerywa czekanie przy zamknięciu.
+ * @return false gdy przyjęcia zamknięto — miejsce nie jest wtedy zajęte
+ */
+static bool acquireAdmission(SharedState* state, int semid) {
+    if (state->max_patients <= 0) return admissionsOpen(state);
+
+    struct sembuf op{};
+    op.sem_num = SEM_ADMISSION;
+    op.sem_op = -1;
+    while (semop(semid, &op, 1) == -1) {
+        if (errno != EINTR) return false;   // EIDRM/EINVAL — IPC usunięte
+        if (!admissionsOpen(state)) return false;
+    }
+    if (!admissionsOpen(state)) {           // Miejsce zwolniono w trakcie drenażu — oddaj je
+        semSignal(semid, SEM_ADMISSION);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief BACKPRESSURE: czeka, aż żadna kolejka specjalisty nie przekracza backlog_limit
+ *
+ * SEM_OVERLOADED liczy przeciążone kolejki (POZ +1, specjalista −1) — semop z sem_op = 0
+ * blokuje do zera bez odpytywania. SIGTERM przerywa czekanie przy zamknięciu.
+ * @return false gdy przyjęcia zamknięto
+ */
+static bool waitBackpressure(SharedState* state, int semid) {
+    if (g_scenario.p.overload_policy != OVERLOAD_BACKPRESSURE) return true;
+    if (semctl(semid, SEM_OVERLOADED, GETVAL) == 0) return admissionsOpen(state);
+
+    long long wait_start = monotonicNs();
+    struct sembuf op{};
+    op.sem_num = SEM_OVERLOADED;
+    op.sem_op = 0;
+    while (semop(semid, &op, 1) == -1) {
+        if (errno != EINTR) return false;   // EIDRM/EINVAL — IPC usunięte
+        if (!admissionsOpen(state)) return false;
+    }
+    recordLatency(state->backpressure_wait, monotonicNs() - wait_start);
+    return admissionsOpen(state);
+}
+
+/// Wiadro żetonów w czasie symulacji: admit_rate żetonów/s, najwyżej admit_burst naraz
+struct TokenBucket {
+    double tokens;
+    long long last_ns;
+};
+
+/// Czeka na żeton — sen wyliczony z deficytu, bez odpytywania
+static void takeToken(SharedState* state, TokenBucket& tb) {
+    double rate = state->admit_rate;
+    if (rate <= 0.0) return;
+
+    long long now = monotonicNs();
+    tb.tokens += (now - tb.last_ns) * g_time_scale / 1e9 * rate;
+    if (tb.tokens > state->admit_burst) tb.tokens = state->admit_burst;
+    tb.last_ns = now;
+
+    if (tb.tokens < 1.0) {
+        msleep((int)ceil((1.0 - tb.tokens) / rate * 1000.0));
+        now = monotonicNs();
+        tb.tokens += (now - tb.last_ns) * g_time_scale / 1e9 * rate;
+        tb.last_ns = now;
+    }
+    tb.tokens -= 1.0;
+}
+
+// ============================================================================
+// ŹRÓDŁA NAPŁYWU — ślad przyjęć (-T) i profil intensywności (-R)
+// ============================================================================
+
+/// Ślad przyjęć zmapowany w pamięci — czytany linia po linii, bez kopiowania całości
+struct ArrivalTrace {
+    const char* base = nullptr;
+    const char* cur = nullptr;
+    const char* end = nullptr;
+    size_t size = 0;
+    long line = 0;
+};
+
+struct TraceArrival {
+    long long t_ms;   // Czas od startu generatora (ms symulacji)
+    int age;
+    int is_vip;
+};
+
+static bool openTrace(const char* path, ArrivalTrace& tr) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) { SOR_WARN("Generator: open %s", path); return false; }
+
+    struct stat st{};
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        fprintf(stderr, "Generator: ślad %s jest pusty\n", path);
+        return false;
+    }
+
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) { SOR_WARN("Generator: mmap %s", path); return false; }
+    madvise(base, st.st_size, MADV_SEQUENTIAL);  // Odczyt z wyprzedzeniem, strony zwalniane za nami
+
+    tr.base = tr.cur = (const char*)base;
+    tr.end = tr.base + st.st_size;
+    tr.size = st.st_size;
+    return true;
+}
+
+static void closeTrace(ArrivalTrace& tr) {
+    if (tr.base) munmap((void*)tr.base, tr.size);
+    tr = ArrivalTrace{};
+}
+
+/// Parsuje liczbę całkowitą w [p, eol) — separatory: spacja, tab, przecinek, średnik
+static bool parseField(const char*& p, const char* eol, long long* out) {
+    while (p < eol && (*p == ' ' || *p == '\t' || *p == ',' || *p == ';' || *p == '\r')) p++;
+    if (p >= eol || *p < '0' || *p > '9') return false;
+    long long v = 0;
+    while (p < eol && *p >= '0' && *p <= '9') v = v * 10 + (*p++ - '0');
+    *out = v;
+    return true;
+}
+
+/// Następne przyjęcie ze śladu; błędne linie są pomijane z ostrzeżeniem. false = koniec śladu.
+static bool nextTraceArrival(ArrivalTrace& tr, TraceArrival* out) {
+    while (tr.cur < tr.end) {
+        const char* eol = (const char*)memchr(tr.cur, '\n', tr.end - tr.cur);
+        if (!eol) eol = tr.end;
+        const char* p = tr.cur;
+        tr.cur = eol + 1;
+        tr.line++;
+
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == eol || *p == '#') continue;  // Pusta linia lub komentarz
+
+        long long t_ms, age, vip = 0;
+        if (!parseField(p, eol, &t_ms) || !parseField(p, eol, &age) || age < 1 || age > 120) {
+            fprintf(stderr, "Generator: ślad linia %ld — oczekiwano \"czas_ms wiek [vip]\", pomijam\n",
+                    tr.line);
+            continue;
+        }
+        parseField(p, eol, &vip);
+        *out = TraceArrival{ t_ms, (int)age, vip ? 1 : 0 };
+        return true;
+    }
+    return false;
+}
+
+/// Odcinek profilu: od start_s (czas symulacji od startu generatora) intensywność rate
+struct RateSegment {
+    double start_s;
+    double rate;       // Pacjentów na sekundę symulacji
+};
+
+static bool loadRateProfile(const char* path, std::vector<RateSegment>& profile) {
+    FILE* f = fopen(path, "r");
+    if (!f) { SOR_WARN("Generator: fopen %s", path); return false; }
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+
+        RateSegment seg{};
+        if (sscanf(p, "%lf %lf", &seg.start_s, &seg.rate) != 2 || seg.start_s < 0 || seg.rate < 0
+            || (!profile.empty() && seg.start_s <= profile.back().start_s)) {
+            fprintf(stderr, "Generator: profil linia %d — oczekiwano rosnącego \"od_s intensywność\", pomijam\n",
+                    line_no);
+            continue;
+        }
+        profile.push_back(seg);
+    }
+    fclose(f);
+
+    if (profile.empty()) {
+        fprintf(stderr, "Generator: profil %s nie zawiera odcinków\n", path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Czas następnego przyjęcia w niejednorodnym procesie Poissona
+ *
+ * Odwrócenie skumulowanej intensywności: losujemy E ~ Exp(1) i przechodzimy przez
+ * kolejne odcinki odejmując rate·długość aż E się wyczerpie — dokładnie, bez odrzutów.
+ * @return czas [s] lub HUGE_VAL gdy profil kończy się zerową intensywnością
+ */
+static double nextProfileArrival(const std::vector<RateSegment>& profile, double t_s) {
+    double e = -log(randomUniform());
+    size_t i = 0;
+    while (i + 1 < profile.size() && profile[i + 1].start_s <= t_s) i++;
+    if (t_s < profile[0].start_s) t_s = profile[0].start_s;  // Przed pierwszym odcinkiem: zero
+
+    for (;; i++) {
+        double seg_end = (i + 1 < profile.size()) ? profile[i + 1].start_s : HUGE_VAL;
+        double rate = profile[i].rate;
+        if (rate > 0.0) {
+            double need = e / rate;
+            if (t_s + need <= seg_end) return t_s + need;
+            e -= rate * (seg_end - t_s);
+        }
+        if (seg_end == HUGE_VAL) return HUGE_VAL;
+        t_s = seg_end;
+    }
+}
+
+/// Śpi do chwili target_ms (ms symulacji od gen_start_ns)
+static void sleepUntilSimMs(long long gen_start_ns, double target_ms) {
+    double now_ms = (monotonicNs() - gen_start_ns) * g_time_scale / 1e6;
+    if (target_ms > now_ms) msleep((int)(target_ms - now_ms));
+}
+
+// ============================================================================
+// DRENAŻ — pacjenci w SOR kończą wizytę, brak nowych przyjęć
+// ============================================================================
+
+static void drainPatients(SharedState* state, int semid) {
+    semWait(semid, SEM_SHM_MUTEX);
+    int active = state->active_patient_count;
+    semSignal(semid, SEM_SHM_MUTEX);
+    logMessage(state, semid, "[Generator] Drenaż — wstrzymano przyjęcia, czekam na %d pacjentów", active);
+
+    // Blokujący waitpid — SIGTERM (bez SA_RESTART) przerywa drenaż
+    while (!g_gen_shutdown && !state->shutdown) {
+        pid_t ret = waitpid(-1, nullptr, 0);
+        if (ret == -1 && errno == ECHILD) break;
+    }
+
+    if (!g_gen_shutdown && !state->shutdown)
+        logMessage(state, semid, "[Generator] Drenaż zakończony — wszyscy pacjenci opuścili SOR");
+}
+
 // ============================================================================
 // CLEANUP — czyste zamknięcie z zebraniem procesów potomnych
 // ============================================================================
@@ -128,20 +398,25 @@ static void cleanupChildren(SharedState* state, int semid) {
 // ============================================================================
 
 int main(int argc, char* argv[]) {
-    if constexpr (STARTUP_DELAY_GENERATOR_MS > 0)
-        msleep(STARTUP_DELAY_GENERATOR_MS);
+    // Parsowanie argumentów: generator [-T ślad] [-R profil] [min_ms max_ms]
+    const char* trace_path = nullptr;
+    const char* profile_path = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "T:R:")) != -1) {
+        if (opt == 'T') trace_path = optarg;
+        else if (opt == 'R') profile_path = optarg;
+    }
 
-    // Parsowanie opcjonalnych argumentów: generator [min_ms] [max_ms]
-    int gen_min_ms = PATIENT_GEN_MIN_MS;
-    int gen_max_ms = PATIENT_GEN_MAX_MS;
-    if (argc >= 3) {
-        gen_min_ms = atoi(argv[1]);
-        gen_max_ms = atoi(argv[2]);
+    int gen_min_ms = 0;  // 0 = ze scenariusza (po podłączeniu pamięci dzielonej)
+    int gen_max_ms = 0;
+    if (argc - optind >= 2) {
+        gen_min_ms = atoi(argv[optind]);
+        gen_max_ms = atoi(argv[optind + 1]);
         if (gen_min_ms <= 0 || gen_max_ms <= 0 || gen_max_ms < gen_min_ms) {
             fprintf(stderr, "Generator: nieprawidłowe argumenty (%d, %d), używam domyślnych\n",
                     gen_min_ms, gen_max_ms);
-            gen_min_ms = PATIENT_GEN_MIN_MS;
-            gen_max_ms = PATIENT_GEN_MAX_MS;
+            gen_min_ms = 0;
+            gen_max_ms = 0;
         }
     }
 
@@ -167,12 +442,25 @@ int main(int argc, char* argv[]) {
 
     SharedState* state = (SharedState*)shmat(shmid, nullptr, 0);
     if (state == (void*)-1) SOR_FATAL("Generator: shmat");
+    initSimClock(state);
+    initRandom(state);
+    initScenario(state);
+    if (gen_min_ms == 0) {
+        gen_min_ms = g_scenario.p.gen_min_ms;
+        gen_max_ms = g_scenario.p.gen_max_ms;
+    }
+    // Odstępy między przyjęciami z jednego sekwencyjnego strumienia generatora
+    RngScope arrivals_rng(RNG_ROLE_ARRIVALS, 0);
 
     // Podłącz semafory
     key_t sem_key = getIPCKey(SEM_KEY_ID);
     int semid = semget(sem_key, SEM_COUNT, 0);
     if (semid == -1) SOR_FATAL("Generator: semget");
 
+    // Opóźnienie startowe po podłączeniu IPC — msleep skalowany przez time_scale
+    if constexpr (STARTUP_DELAY_GENERATOR_MS > 0)
+        msleep(STARTUP_DELAY_GENERATOR_MS);
+
     logMessage(state, semid, "[Generator] Generator pacjentów startuje (PID %d)", getpid());
 
     int patient_id = 0;
@@ -180,40 +468,81 @@ int main(int argc, char* argv[]) {
     // ===== PRE-GENERACJA: spawnuj PREGEN_COUNT pacjentów back-to-back =====
     if constexpr (PREGEN_MODE == PREGEN_ONLY || PREGEN_MODE == PREGEN_THEN_NORMAL) {
         logMessage(state, semid, "[Generator] Pre-generacja: %d pacjentów back-to-back", PREGEN_COUNT);
-        for (int pg = 0; pg < PREGEN_COUNT && !state->shutdown && !g_gen_shutdown; pg++) {
+        for (int pg = 0; pg < PREGEN_COUNT && admissionsOpen(state); pg++) {
+            if (!acquireAdmission(state, semid)) break;  // Limit -p obowiązuje też tu
             patient_id++;
-            spawnPatient(state, semid, patient_id, randomAge(), randomVIP() ? 1 : 0);
+            spawnPatient(state, semid, patient_id, -1, 0);
         }
         logMessage(state, semid, "[Generator] Pre-generacja zakończona (%d pacjentów)", PREGEN_COUNT);
     }
 
+    // ===== ŹRÓDŁO NAPŁYWU: ślad, profil intensywności albo odstęp losowy =====
+    ArrivalTrace trace;
+    std::vector<RateSegment> profile;
+    if (trace_path && !openTrace(trace_path, trace)) trace_path = nullptr;
+    if (profile_path && !loadRateProfile(profile_path, profile)) profile_path = nullptr;
+    if (trace_path)
+        logMessage(state, semid, "[Generator] Odtwarzanie śladu przyjęć %s (%zu B)", trace_path, trace.size);
+    else if (profile_path)
+        logMessage(state, semid, "[Generator] Profil intensywności %s (%zu odcinków)",
+                  profile_path, profile.size());
+
     // ===== NORMALNA GENERACJA (pominięta w trybie PREGEN_ONLY) =====
     if constexpr (PREGEN_MODE != PREGEN_ONLY) {
-        while (!state->shutdown && !g_gen_shutdown) {
-            randomSleep(gen_min_ms, gen_max_ms);
-            if (state->shutdown || g_gen_shutdown) break;
-
-            // Czekaj jeśli osiągnięto limit jednoczesnych procesów pacjentów
-            int patient_limit = state->max_patients - FIXED_PROCESS_COUNT;
-            if (state->max_patients > 0 && patient_limit > 0) {
-                while (!state->shutdown && !g_gen_shutdown) {
-                    semWait(semid, SEM_SHM_MUTEX);
-                    int active = state->active_patient_count;
-                    semSignal(semid, SEM_SHM_MUTEX);
-                    if (active < patient_limit) break;
-                    usleep(100000);
+        long long gen_start_ns = monotonicNs();
+        double profile_t_s = 0.0;
+        TokenBucket bucket{ (double)state->admit_burst, gen_start_ns };
+
+        while (admissionsOpen(state)) {
+            int age, is_vip;
+            double sweep_rate = state->gen_rate;  // Ustawiane przez dyrektora krok po kroku (-S)
+            if (sweep_rate > 0.0) {
+                msleep((int)(-log(randomUniform()) / sweep_rate * 1000.0));
+                age = -1;
+                is_vip = 0;
+            } else if (trace_path) {
+                TraceArrival a;
+                if (!nextTraceArrival(trace, &a)) {
+                    logMessage(state, semid, "[Generator] Koniec śladu przyjęć (%d pacjentów)", patient_id);
+                    break;
+                }
+                sleepUntilSimMs(gen_start_ns, (double)a.t_ms);
+                age = a.age;
+                is_vip = a.is_vip;
+            } else if (profile_path) {
+                profile_t_s = nextProfileArrival(profile, profile_t_s);
+                if (profile_t_s == HUGE_VAL) {
+                    logMessage(state, semid, "[Generator] Profil kończy się zerową intensywnością");
+                    break;
                 }
-                if (state->shutdown || g_gen_shutdown) break;
+                sleepUntilSimMs(gen_start_ns, profile_t_s * 1000.0);
+                age = -1;
+                is_vip = 0;
+            } else {
+                randomSleep(gen_min_ms, gen_max_ms);
+                age = -1;
+                is_vip = 0;
             }
 
+            // Przeciążone kolejki (BACKPRESSURE), wiadro żetonów (-b), miejsce w limicie (-p)
+            if (!waitBackpressure(state, semid)) break;
+            long long wait_start = monotonicNs();
+            takeToken(state, bucket);
+            if (!acquireAdmission(state, semid)) break;
+            if (state->admit_rate > 0.0 || state->max_patients > 0)
+                recordLatency(state->admission_wait, monotonicNs() - wait_start);
+
             patient_id++;
-            spawnPatient(state, semid, patient_id, randomAge(), randomVIP() ? 1 : 0);
+            spawnPatient(state, semid, patient_id, age, is_vip);
         }
-    } else {
-        // PREGEN_ONLY — czekaj aż dyrektor wyśle shutdown
-        while (!state->shutdown && !g_gen_shutdown)
-            usleep(500000);
     }
+    closeTrace(trace);
+
+    // Koniec źródła (PREGEN_ONLY, ślad, profil) — czekaj aż dyrektor wyśle shutdown lub drenaż
+    while (admissionsOpen(state))
+        usleep(500000);
+
+    if (state->draining) drainPatients(state, semid);
 
     // ==== CZYSTE ZAMKNIĘCIE ====
     cleanupChildren(state, semid);
@@ -6,6 +6,10 @@
  * 1. Lekarz POZ (triaż) — wstępna ocena, przypisanie koloru i specjalisty
  * 2. Lekarze specjaliści — badania, leczenie, decyzja o dalszym postępowaniu
  * 
+ * Specjalność może mieć kilka instancji (DOCTOR_STAFF / doctor_staff_*): wszystkie
+ * odbierają z tej samej kolejki specjalisty z priorytetem koloru. Dyrektor może dokładać
+ * instancje w trakcie (autoskalowanie) i wycofywać je sygnałem SIGTERM.
+ *
  * Sygnały:
  * - SIGUSR1: lekarz kończy obecnego pacjenta i idzie na oddział (przerwa)
  * - SIGUSR2: natychmiastowe zakończenie (ewakuacja)
@@ -13,12 +17,19 @@
  */
 
 #include "sor_common.hpp"
+#include "sor_registry.hpp"
+#include "sor_triage.hpp"
+#include "sor_ward.hpp"
+#include <climits>
+#include <sys/time.h>
 
 // ============================================================================
 // ZMIENNE GLOBALNE
 // ============================================================================
 
 static DoctorType g_doctor_type;
+static int g_instance = 0;        // Numer instancji w obsadzie specjalności (0..staff-1)
+static char g_label[32];          // "chirurg" albo "chirurg #2" przy obsadzie > 1
 static SharedState* g_state = nullptr;
 static int g_semid = -1;
 static int g_msgid = -1;
@@ -26,6 +37,10 @@ static int g_msgid = -1;
 static volatile sig_atomic_t g_shutdown = 0;
 static volatile sig_atomic_t g_go_to_ward = 0;
 static volatile sig_atomic_t g_treating = 0;  // SIGUSR1 czeka aż lekarz skończy pacjenta
+static volatile sig_atomic_t g_preempt = 0;   // SIGRTMIN: czerwony czeka w kolejce
+static volatile sig_atomic_t g_steal = 0;     // SIGRTMIN+1: zgodna kolejka ma zaległości
+
+static Registry g_registry;   // Tylko POZ — zapis wyniku triażu do rejestru pacjentów
 
 // ============================================================================
 // HELPERY
@@ -41,16 +56,30 @@ static const char* const OUTCOME_NAMES[] = {
     "skierowany do innej placówki"
 };
 
-/// Bezpieczny msgsnd z obsługą EINTR/EIDRM — zwraca true jeśli sukces
-static bool safeMsgsnd(int qid, SORMessage& msg, const char* ctx) {
-    if (msgsnd(qid, &msg, sizeof(SORMessage) - sizeof(long), 0) == -1) {
-        if (errno != EINTR && errno != EIDRM)
+/// Bezpieczny msgsnd z obsługą EINTR/EIDRM (i EAGAIN przy IPC_NOWAIT) — zwraca true jeśli sukces
+static bool safeMsgsnd(int qid, SORMessage& msg, const char* ctx, int flags = 0) {
+    if (msgsnd(qid, &msg, sizeof(SORMessage) - sizeof(long), flags) == -1) {
+        if (errno != EINTR && errno != EIDRM && errno != EAGAIN)
             SOR_WARN("%s msgsnd pacjent %d", ctx, msg.patient_id);
         return false;
     }
+    bumpHandoffSeq(g_state);
     return true;
 }
 
+/**
+ * @brief mtype w kolejce specjalisty: kolor (ścisły priorytet) albo termin (EDF)
+ *
+ * W trybie EDF mtype = termin (CLOCK_MONOTONIC, wspólny dla procesów) w krokach 0,1 ms;
+ * msgrcv z -LONG_MAX zwraca najmniejszy mtype, czyli najwcześniejszy termin —
+ * wszystkie instancje specjalisty korzystają z tego samego porządku w jądrze.
+ */
+static long specialistMtype(const SORMessage& msg) {
+    if (g_scenario.p.specialist_sched != SCHED_EDF) return colorToMtype(msg.color);
+    long long deadline_ns = msg.enqueued_ns + (long long)(g_scenario.p.deadline_ms[msg.color] * 1e6 / g_time_scale);
+    return (long)(deadline_ns / 100000) + 1;
+}
+
 // ============================================================================
 // INICJALIZACJA IPC
 // ============================================================================
@@ -62,6 +91,9 @@ static void initIPC() {
 
     g_state = (SharedState*)shmat(shmid, nullptr, 0);
     if (g_state == (void*)-1) SOR_FATAL("lekarz %s: shmat", getDoctorName(g_doctor_type));
+    initSimClock(g_state);
+    initRandom(g_state);
+    initScenario(g_state);
 
     key_t sem_key = getIPCKey(SEM_KEY_ID);
     g_semid = semget(sem_key, SEM_COUNT, 0);
@@ -79,6 +111,12 @@ static void initIPC() {
 static void signalHandler(int sig) {
     if (sig == SIGUSR1)
         g_go_to_ward = 1;
+    else if (sig == SIGRTMIN)
+        g_preempt = 1;
+    else if (sig == SIGRTMIN + 1)
+        g_steal = 1;
+    else if (sig == SIGALRM)
+        ;  // Tylko przerywa msgrcv — ponowny przegląd kolejek (receivePatient)
     else
         g_shutdown = 1;  // SIGUSR2, SIGTERM, SIGINT
 }
@@ -93,105 +131,562 @@ static void setupSignals() {
     sigaction(SIGUSR2, &sa, nullptr);
     sigaction(SIGTERM, &sa, nullptr);
     sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGRTMIN, &sa, nullptr);
+    sigaction(SIGRTMIN + 1, &sa, nullptr);
+    sigaction(SIGALRM, &sa, nullptr);
 }
 
 // ============================================================================
 // PRZERWA NA ODDZIALE (SIGUSR1)
 // ============================================================================
 
+/// Czy inna instancja tej specjalności jest czynna i nie na przerwie (pod SEM_SHM_MUTEX)
+static bool hasAvailableColleague() {
+    for (int inst = 0; inst < maxDoctorStaff(g_scenario.p, g_doctor_type); inst++) {
+        if (inst != g_instance && g_state->doctor_pids[g_doctor_type][inst] > 0
+            && !g_state->doctor_on_break[g_doctor_type][inst])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Przerwa na oddziale; plan dyrektora mógł się zdezaktualizować od wysłania SIGUSR1,
+ *        więc warunek "nie ostatni dostępny lekarz przy czerwonym w kolejce" jest sprawdzany
+ *        ponownie pod SEM_SHM_MUTEX. Gdy nie jest spełniony, przerwa zostaje odłożona —
+ *        g_go_to_ward zostaje ustawione i lekarz próbuje znowu po kolejnym pacjencie.
+ */
 static void goToWard() {
+    semWait(g_semid, SEM_SHM_MUTEX);
+    if (__atomic_load_n(&g_state->red_queued[g_doctor_type], __ATOMIC_RELAXED) > 0 && !hasAvailableColleague()) {
+        semSignal(g_semid, SEM_SHM_MUTEX);
+        logMessage(g_state, g_semid, "Lekarz %s odkłada przerwę — czerwony w kolejce, brak wolnego kolegi",
+                  g_label);
+        return;
+    }
+    g_state->doctor_on_break[g_doctor_type][g_instance] = 1;
+    g_state->doctor_stats[g_doctor_type][g_instance].breaks++;
+    semSignal(g_semid, SEM_SHM_MUTEX);
+
     logMessage(g_state, g_semid, "Lekarz %s idzie na oddział (przerwa)",
-              getDoctorName(g_doctor_type));
+              g_label);
+
+    long long break_start = monotonicNs();
+    randomSleep(g_scenario.p.break_min_ms, g_scenario.p.break_max_ms);
 
     semWait(g_semid, SEM_SHM_MUTEX);
-    g_state->doctor_on_break[g_doctor_type] = 1;
+    g_state->doctor_on_break[g_doctor_type][g_instance] = 0;
+    g_state->doctor_stats[g_doctor_type][g_instance].break_ns += monotonicNs() - break_start;
     semSignal(g_semid, SEM_SHM_MUTEX);
 
-    randomSleep(DOCTOR_BREAK_MIN_MS, DOCTOR_BREAK_MAX_MS);
+    logMessage(g_state, g_semid, "Lekarz %s wraca z oddziału", g_label);
+    g_go_to_ward = 0;
+}
+
+// ============================================================================
+// WYWŁASZCZANIE (SIGRTMIN)
+// ============================================================================
+
+/**
+ * @brief Wywołuje POZ po skierowaniu czerwonego: jeśli żadna instancja specjalisty nie
+ *        jest wolna, SIGRTMIN dostaje ta, która leczy najniższy kolor (czerwonego nie przerywa)
+ */
+static void preemptForRed(DoctorType specialist) {
+    int victim = -1;
+    int victim_color = COLOR_RED;
+    for (int inst = 0; inst < maxDoctorStaff(g_scenario.p, specialist); inst++) {
+        if (g_state->doctor_pids[specialist][inst] <= 0 || g_state->doctor_on_break[specialist][inst])
+            continue;
+        int treating = __atomic_load_n(&g_state->doctor_treating[specialist][inst], __ATOMIC_RELAXED);
+        if (treating == COLOR_NONE) return;  // Wolna instancja sama podejmie czerwonego
+        if (treating > victim_color) {
+            victim = inst;
+            victim_color = treating;
+        }
+    }
+    if (victim >= 0) kill(g_state->doctor_pids[specialist][victim], SIGRTMIN);
+}
+
+/// Czy któraś instancja specjalności czeka bezczynnie na pacjenta
+static bool hasIdleInstance(DoctorType type) {
+    for (int inst = 0; inst < maxDoctorStaff(g_scenario.p, type); inst++) {
+        if (g_state->doctor_pids[type][inst] > 0 && !g_state->doctor_on_break[type][inst]
+            && __atomic_load_n(&g_state->doctor_treating[type][inst], __ATOMIC_RELAXED) == COLOR_NONE)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Work stealing: gdy nikt w specjalności nie jest wolny, POZ budzi (SIGRTMIN+1)
+ *        pierwszego bezczynnego lekarza, którego steal_mask obejmuje tę kolejkę
+ */
+static void wakeIdleThief(DoctorType specialist) {
+    if (hasIdleInstance(specialist)) return;
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (d == specialist || !g_scenario.p.doctor_enabled[d]) continue;
+        if (!(g_scenario.p.steal_mask[d] & (1 << specialist))) continue;
+        for (int inst = 0; inst < maxDoctorStaff(g_scenario.p, d); inst++) {
+            pid_t pid = g_state->doctor_pids[d][inst];
+            if (pid > 0 && !g_state->doctor_on_break[d][inst]
+                && __atomic_load_n(&g_state->doctor_treating[d][inst], __ATOMIC_RELAXED) == COLOR_NONE) {
+                kill(pid, SIGRTMIN + 1);
+                return;
+            }
+        }
+    }
+}
+
+// ============================================================================
+// PRZECIĄŻENIE (overload_policy)
+// ============================================================================
+
+/// Liczba pacjentów w kolejce specjalności (IPC_STAT)
+static long queueDepth(DoctorType type) {
+    struct msqid_ds qs;
+    return msgctl(g_state->specialist_msgids[type], IPC_STAT, &qs) == 0 ? (long)qs.msg_qnum : 0;
+}
+
+/**
+ * @brief BACKPRESSURE: przejście kolejki w/z przeciążenia; SEM_OVERLOADED liczy przeciążone
+ *        kolejki, a generator przed przyjęciem czeka, aż spadnie do zera
+ */
+static void setOverloaded(DoctorType type, bool over, long depth) {
+    int expected = over ? 0 : 1;
+    if (!__atomic_compare_exchange_n(&g_state->backlog_over[type], &expected, over ? 1 : 0, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;  // Przejście wykonał już inny lekarz
+    if (over) {
+        semSignal(g_semid, SEM_OVERLOADED);
+        logMessage(g_state, g_semid, "[Przeciążenie] Kolejka %s: %ld pacjentów — wstrzymanie przyjęć",
+                  getDoctorName(type), depth);
+    } else {
+        semWait(g_semid, SEM_OVERLOADED);
+        logMessage(g_state, g_semid, "[Przeciążenie] Kolejka %s: %ld pacjentów — wznowienie przyjęć",
+                  getDoctorName(type), depth);
+    }
+}
+
+/// Odpowiedź triażu dla pacjenta, który nie idzie do specjalisty — od razu bilet wyjścia
+static void releaseFromTriage(SORMessage& msg, int outcome) {
+    msg.mtype = MSG_TRIAGE_RESPONSE + msg.patient_id;
+    msg.assigned_doctor = DOCTOR_POZ;
+    msg.outcome = outcome;
 
     semWait(g_semid, SEM_SHM_MUTEX);
-    g_state->doctor_on_break[g_doctor_type] = 0;
+    msg.exit_ticket = g_state->exit_next_ticket++;
     semSignal(g_semid, SEM_SHM_MUTEX);
 
-    logMessage(g_state, g_semid, "Lekarz %s wraca z oddziału", getDoctorName(g_doctor_type));
-    g_go_to_ward = 0;
+    msg.sent_ns = monotonicNs();
+    safeMsgsnd(g_msgid, msg, "POZ");
+}
+
+/// Sen leczenia (czas ścienny) przerywany przez SIGRTMIN — zwraca pozostały czas, 0 = koniec
+static long long treatmentSleep(long long ns) {
+    if (g_preempt) return ns;
+    struct timespec req;
+    req.tv_sec  = ns / 1000000000LL;
+    req.tv_nsec = ns % 1000000000LL;
+    while (nanosleep(&req, &req) == -1 && errno == EINTR) {
+        if (g_preempt) return req.tv_sec * 1000000000LL + req.tv_nsec;
+    }
+    return 0;
 }
 
 // ============================================================================
 // LEKARZ POZ (TRIAŻ) — nie reaguje na SIGUSR1
 // ============================================================================
 
+/**
+ * @brief Wysyła pacjenta do kolejki specjalisty; przy overload_policy bez blokowania triażu
+ *
+ * Pełna kolejka jądra (msg_qbytes) zatrzymałaby blokujący msgsnd POZ dla każdego koloru.
+ * Przy DIVERT/SEND_HOME wysyłka jest IPC_NOWAIT, a EAGAIN oddaje decyzję wywołującemu;
+ * przy BACKPRESSURE EAGAIN przełącza kolejkę w przeciążenie (wstrzymanie generatora)
+ * i dopiero wtedy czeka na miejsce. OVERLOAD_NONE zachowuje blokujący msgsnd.
+ * @return false gdy kolejka pełna (tylko DIVERT/SEND_HOME) albo błąd msgsnd
+ */
+static bool sendToSpecialist(SORMessage& msg, DoctorType specialist) {
+    int qid = g_state->specialist_msgids[specialist];
+    int policy = g_scenario.p.overload_policy;
+    if (policy == OVERLOAD_NONE) return safeMsgsnd(qid, msg, "POZ→specjalista");
+    if (safeMsgsnd(qid, msg, "POZ→specjalista", IPC_NOWAIT)) return true;
+    if (errno != EAGAIN || policy != OVERLOAD_BACKPRESSURE) return false;
+    setOverloaded(specialist, true, queueDepth(specialist));
+    return safeMsgsnd(qid, msg, "POZ→specjalista");
+}
+
+/**
+ * @brief Skierowanie do kolejki specjalisty i odpowiedź triażu (depth — stan kolejki przed wysłaniem)
+ * @return false gdy kolejka specjalisty jest pełna — pacjenta trzeba odesłać (shedPatient)
+ */
+static bool routeToSpecialist(SORMessage& msg, DoctorType specialist, long depth) {
+    msg.assigned_doctor = specialist;
+
+    logMessage(g_state, g_semid,
+              "Pacjent %d%s uzyskuje status [%s] — kierowany do lekarza: %s",
+              msg.patient_id, childTag(msg.age), getColorName(msg.color), getDoctorName(specialist));
+
+    logMessage(g_state, g_semid,
+              "Pacjent %d%s czeka na lekarza: %s (kolor: %s)",
+              msg.patient_id, childTag(msg.age), getDoctorName(specialist), getColorName(msg.color));
+
+    // Wyślij do dedykowanej kolejki specjalisty (mtype koduje kolor albo termin EDF)
+    msg.enqueued_ns = monotonicNs();
+    msg.mtype = specialistMtype(msg);
+    if (msg.color == COLOR_RED) __atomic_fetch_add(&g_state->red_queued[specialist], 1, __ATOMIC_RELAXED);
+    if (!sendToSpecialist(msg, specialist)) {
+        if (msg.color == COLOR_RED) __atomic_fetch_sub(&g_state->red_queued[specialist], 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    registryRecordTriage(g_registry, msg.identity, msg.color, specialist);
+    if (msg.color == COLOR_RED && g_scenario.p.preempt_red) preemptForRed(specialist);
+    if (g_scenario.p.work_stealing) wakeIdleThief(specialist);
+    if (g_scenario.p.overload_policy == OVERLOAD_BACKPRESSURE && depth + 1 >= g_scenario.p.backlog_limit)
+        setOverloaded(specialist, true, depth + 1);
+
+    // Wyślij odpowiedź triażu do pacjenta
+    msg.mtype = MSG_TRIAGE_RESPONSE + msg.patient_id;
+    msg.sent_ns = monotonicNs();
+    safeMsgsnd(g_msgid, msg, "POZ→pacjent");
+    return true;
+}
+
+/**
+ * @brief DIVERT/SEND_HOME: pacjent nie wchodzi do pełnej kolejki specjalisty
+ *
+ * Zielony — wg polityki (inna placówka albo dom). Czerwony i żółty trafiają tu tylko przy
+ * pełnej kolejce jądra i nie są odsyłani do domu: zawsze inna placówka.
+ */
+static void shedPatient(SORMessage& msg, DoctorType specialist, long depth) {
+    int outcome = g_scenario.p.overload_policy == OVERLOAD_SEND_HOME && msg.color == COLOR_GREEN ? 0 : 2;
+    logMessage(g_state, g_semid, "Pacjent %d%s [%s] — kolejka %s pełna (%ld), %s",
+              msg.patient_id, childTag(msg.age), getColorName(msg.color),
+              getDoctorName(specialist), depth, OUTCOME_NAMES[outcome]);
+    __atomic_fetch_add(&g_state->shed[specialist], 1, __ATOMIC_RELAXED);
+    releaseFromTriage(msg, outcome);
+    registryRecordTriage(g_registry, msg.identity, msg.color, DOCTOR_POZ);
+}
+
+/// Decyzja triażu podjęta przed badaniem (losowania w strumieniu pacjenta)
+struct TriageDecision {
+    int exam_ms;
+    TriageColor color;
+    DoctorType specialist;   // DOCTOR_POZ gdy odesłany do domu
+};
+
+/// Badanie i skierowanie jednego pacjenta wg gotowej decyzji
+static void triagePatient(SORMessage& msg, const TriageDecision& d) {
+    long long busy_start = monotonicNs();
+
+    logMessage(g_state, g_semid, "Pacjent %d%s jest weryfikowany przez lekarza %s",
+              msg.patient_id, childTag(msg.age), g_label);
+    if (msg.prev_visits > 0)
+        logMessage(g_state, g_semid, "Pacjent %d%s — historia: %d wizyt, ostatni kolor [%s]",
+                  msg.patient_id, childTag(msg.age), msg.prev_visits, getColorName(msg.prev_color));
+
+    msleep(d.exam_ms);
+    TriageColor color = d.color;
+    msg.color = color;
+
+    if (color == COLOR_SENT_HOME) {
+        // Pacjent odsyłany do domu bezpośrednio z triażu
+        logMessage(g_state, g_semid, "Pacjent %d%s odesłany do domu z triażu",
+                  msg.patient_id, childTag(msg.age));
+        releaseFromTriage(msg, 0);
+        registryRecordTriage(g_registry, msg.identity, color, DOCTOR_POZ);
+    } else {
+        DoctorType specialist = d.specialist;
+        int policy = g_scenario.p.overload_policy;
+        long depth = policy != OVERLOAD_NONE ? queueDepth(specialist) : 0;
+
+        if (color == COLOR_GREEN && (policy == OVERLOAD_DIVERT || policy == OVERLOAD_SEND_HOME)
+            && depth >= g_scenario.p.backlog_limit) {
+            // Ponad limit: zielony nie czeka — czerwoni i żółci mają ograniczone czekanie
+            shedPatient(msg, specialist, depth);
+        } else if (!routeToSpecialist(msg, specialist, depth) && errno == EAGAIN) {
+            // Kolejka jądra pełna (IPC_NOWAIT → EAGAIN) — dotyczy każdego koloru
+            shedPatient(msg, specialist, queueDepth(specialist));
+        }
+    }
+
+    DoctorStats& ds = g_state->doctor_stats[DOCTOR_POZ][g_instance];
+    ds.served++;
+    ds.busy_ns += monotonicNs() - busy_start;
+}
+
+/// TRIAGE_RANDOM: kolor wprost z wag, specjalista z tablicy aliasów
+static TriageDecision randomTriage(const SORMessage& msg) {
+    // Strumień (triaż, pacjent) — czas, kolor i specjalista powtarzalne dla ziarna -s
+    RngScope rng(RNG_ROLE_TRIAGE, (uint32_t)msg.patient_id);
+    TriageDecision d;
+    d.exam_ms = randomInt(g_scenario.p.triage_min_ms, g_scenario.p.triage_max_ms);
+    d.color = randomTriageColor();
+    d.specialist = d.color == COLOR_SENT_HOME ? DOCTOR_POZ : randomSpecialist(msg.age);
+    return d;
+}
+
+// ============================================================================
+// TRIAŻ NEWS2 PARTIAMI (TRIAGE_MODE = TRIAGE_NEWS)
+// ============================================================================
+
+struct TriageBatch {
+    SORMessage msg[TRIAGE_BATCH_MAX];
+    TriageDecision decision[TRIAGE_BATCH_MAX];
+    VitalsBatch vitals;
+};
+
+/// Dopisuje pacjenta do partii: czas badania, kierunek zapasowy i parametry życiowe
+static void addToTriageBatch(TriageBatch& b, const SORMessage& msg) {
+    // Ukryta ostrość z wag triażu, z niej parametry — strumień (triaż, pacjent)
+    RngScope rng(RNG_ROLE_TRIAGE, (uint32_t)msg.patient_id);
+    b.msg[b.vitals.n] = msg;
+    TriageDecision& d = b.decision[b.vitals.n];
+    d.exam_ms = randomInt(g_scenario.p.triage_min_ms, g_scenario.p.triage_max_ms);
+    d.specialist = randomSpecialist(msg.age);   // Kierunek, gdy parametry nie wskazują innego
+    generateVitals(b.vitals, randomTriageColor());
+}
+
+/**
+ * @brief Dobiera do partii pacjentów z kolejnymi biletami, którzy już czekają
+ *
+ * Partię bada jeden lekarz po kolei, więc przy kilku POZ nie bierze więcej niż swój
+ * udział czekających (ceil(czekający / obsada POZ)) — reszta zostaje dla pozostałych.
+ * @return 0, albo bilet podjęty (CAS), którego pacjent jeszcze nie wysłał — na niego
+ *         POZ czeka blokująco po obsłużeniu partii
+ */
+static long gatherTriageBatch(TriageBatch& b) {
+    long waiting = b.vitals.n + __atomic_load_n(&g_state->triage_next_ticket, __ATOMIC_RELAXED)
+                 - __atomic_load_n(&g_state->triage_dispatch_next, __ATOMIC_RELAXED);
+    int staff = g_scenario.p.doctor_staff[DOCTOR_POZ];
+    long limit = (waiting + staff - 1) / staff;
+    if (limit > TRIAGE_BATCH_MAX) limit = TRIAGE_BATCH_MAX;
+    while (b.vitals.n < limit) {
+        long t = __atomic_load_n(&g_state->triage_dispatch_next, __ATOMIC_RELAXED);
+        if (t >= __atomic_load_n(&g_state->triage_next_ticket, __ATOMIC_RELAXED)) return 0;  // Nikt więcej
+        if (!__atomic_compare_exchange_n(&g_state->triage_dispatch_next, &t, t + 1, false,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            continue;  // Bilet wziął inny POZ
+        SORMessage m;
+        if (msgrcv(g_state->triage_msgid, &m, sizeof(SORMessage) - sizeof(long), t, IPC_NOWAIT) == -1)
+            return t;
+        addToTriageBatch(b, m);
+    }
+    return 0;
+}
+
+/// Punktacja partii jednym przebiegiem jądra SoA, potem kolor i kierunek każdego pacjenta
+static void scoreTriageBatch(TriageBatch& b) {
+    long long t0 = monotonicNs();
+    scoreVitals(b.vitals);
+    long long score_ns = monotonicNs() - t0;
+
+    for (int i = 0; i < b.vitals.n; i++) {
+        TriageDecision& d = b.decision[i];
+        d.color = newsColor(b.vitals, i);
+        d.specialist = d.color == COLOR_SENT_HOME ? DOCTOR_POZ
+                                                  : newsSpecialist(b.vitals, i, b.msg[i].age, d.specialist);
+        __atomic_fetch_add(&g_state->triage_news_color[d.color], 1, __ATOMIC_RELAXED);
+        logMessage(g_state, g_semid,
+                  "Pacjent %d%s — NEWS2 %d (oddechy %.0f, SpO2 %.0f%%, RR %.0f, tętno %.0f, %.1f°C, GCS %.0f)",
+                  b.msg[i].patient_id, childTag(b.msg[i].age), b.vitals.score[i], b.vitals.resp_rate[i],
+                  b.vitals.spo2[i], b.vitals.systolic[i], b.vitals.heart_rate[i], b.vitals.temp[i],
+                  b.vitals.gcs[i]);
+    }
+    __atomic_fetch_add(&g_state->triage_batches, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_state->triage_batched, b.vitals.n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_state->triage_score_ns, score_ns, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Pętla triażu. Wolny POZ bierze kolejny bilet triażowy (fetch_add) i czeka
+ *        dokładnie na pacjenta z tym biletem — kilka instancji dzieli pracę, a pacjenci
+ *        są podejmowani w kolejności biletów z rejestracji. W trybie NEWS do pierwszego
+ *        pacjenta dobierani są już czekający z kolejnymi biletami (partia do TRIAGE_BATCH_MAX).
+ */
 static void runPOZ() {
+    long ticket = 0;  // Podjęty bilet — zachowany przy EINTR, inaczej pacjent utknąłby w kolejce
+    TriageBatch batch;
     while (!g_shutdown && !g_state->shutdown) {
+        if (ticket == 0) ticket = __atomic_fetch_add(&g_state->triage_dispatch_next, 1, __ATOMIC_RELAXED);
+
         SORMessage msg;
-        ssize_t ret = msgrcv(g_msgid, &msg, sizeof(SORMessage) - sizeof(long),
-                             MSG_PATIENT_TO_TRIAGE, 0);
+        ssize_t ret = msgrcv(g_state->triage_msgid, &msg, sizeof(SORMessage) - sizeof(long), ticket, 0);
         if (ret == -1) {
             if (errno == EIDRM || errno == EINVAL) break;
             continue;  // EINTR lub inny — sprawdź warunki pętli
         }
+        ticket = 0;
 
-        logMessage(g_state, g_semid, "Pacjent %d%s jest weryfikowany przez lekarza POZ",
-                  msg.patient_id, childTag(msg.age));
+        if (g_scenario.p.triage_mode != TRIAGE_NEWS) {
+            triagePatient(msg, randomTriage(msg));
+            continue;
+        }
 
-        randomSleep(TRIAGE_MIN_MS, TRIAGE_MAX_MS);
+        batch.vitals.n = 0;
+        addToTriageBatch(batch, msg);
+        ticket = gatherTriageBatch(batch);
+        scoreTriageBatch(batch);
+        for (int i = 0; i < batch.vitals.n; i++)
+            triagePatient(batch.msg[i], batch.decision[i]);
+    }
+}
+
+// ============================================================================
+// LEKARZ SPECJALISTA
+// ============================================================================
 
-        TriageColor color = randomTriageColor();
-        msg.color = color;
+/// Podjęcie z kolejki queue (także przy przejęciu): czekanie, przekroczenia terminu, licznik czerwonych
+static void recordSpecialistWait(const SORMessage& msg, DoctorType queue, long long busy_start) {
+    long long waited_ns = busy_start - msg.enqueued_ns;
+    recordLatency(g_state->specialist_wait[queue], waited_ns);
+    if (msg.color == COLOR_RED) __atomic_fetch_sub(&g_state->red_queued[queue], 1, __ATOMIC_RELAXED);
+
+    bool colleague_away = false;
+    for (int inst = 0; inst < maxDoctorStaff(g_scenario.p, queue); inst++)
+        if (g_state->doctor_on_break[queue][inst]) colleague_away = true;
+    recordLatency(g_state->break_wait[colleague_away ? 1 : 0], waited_ns);
+    if (msg.color >= COLOR_RED && msg.color <= COLOR_GREEN) {
+        recordLatency(g_state->color_wait[msg.color], waited_ns);
+        if (waited_ns * g_time_scale > g_scenario.p.deadline_ms[msg.color] * 1e6)
+            __atomic_fetch_add(&g_state->deadline_miss[msg.color], 1, __ATOMIC_RELAXED);
+    }
+}
 
-        if (color == COLOR_SENT_HOME) {
-            // Pacjent odsyłany do domu bezpośrednio z triażu
-            logMessage(g_state, g_semid, "Pacjent %d%s odesłany do domu z triażu",
-                      msg.patient_id, childTag(msg.age));
+/// Wynik leczenia: bilet wyjścia, odpowiedź do pacjenta i statystyki instancji
+static void finishTreatment(SORMessage& msg, int outcome, long long busy_ns) {
+    msg.outcome = outcome;
 
-            msg.mtype = MSG_TRIAGE_RESPONSE + msg.patient_id;
-            msg.assigned_doctor = DOCTOR_POZ;
-            msg.outcome = 0;
+    const char* outcome_str = (outcome >= 0 && outcome <= 2) ? OUTCOME_NAMES[outcome] : "nieznany";
+    logMessage(g_state, g_semid, "Pacjent %d%s — %s",
+              msg.patient_id, childTag(msg.age), outcome_str);
 
-            semWait(g_semid, SEM_SHM_MUTEX);
-            msg.exit_ticket = g_state->exit_next_ticket++;
-            semSignal(g_semid, SEM_SHM_MUTEX);
+    // Przydziel bilet wyjścia — czekający na łóżko bierze go sam po przyjęciu na oddział,
+    // inaczej jego bilet wstrzymałby wyjścia wszystkich następnych pacjentów
+    if (outcome == 1 && wardLimited(msg.assigned_doctor)) {
+        msg.exit_ticket = 0;
+    } else {
+        semWait(g_semid, SEM_SHM_MUTEX);
+        msg.exit_ticket = g_state->exit_next_ticket++;
+        semSignal(g_semid, SEM_SHM_MUTEX);
+    }
 
-            safeMsgsnd(g_msgid, msg, "POZ");
-        } else {
-            // Przypisz specjalistę i kolor
-            DoctorType specialist = randomSpecialist(msg.age);
-            msg.assigned_doctor = specialist;
+    msg.mtype = MSG_SPECIALIST_RESPONSE + msg.patient_id;
+    msg.sent_ns = monotonicNs();
+    safeMsgsnd(g_msgid, msg, g_label);
 
-            logMessage(g_state, g_semid,
-                      "Pacjent %d%s uzyskuje status [%s] — kierowany do lekarza: %s",
-                      msg.patient_id, childTag(msg.age), getColorName(color), getDoctorName(specialist));
+    // Atomowo: wycofywana instancja może jeszcze kończyć pacjenta, gdy slot dostał następcę
+    DoctorStats& ds = g_state->doctor_stats[g_doctor_type][g_instance];
+    __atomic_fetch_add(&ds.served, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&ds.busy_ns, busy_ns, __ATOMIC_RELAXED);
+}
 
-            logMessage(g_state, g_semid,
-                      "Pacjent %d%s czeka na lekarza: %s (kolor: %s)",
-                      msg.patient_id, childTag(msg.age), getDoctorName(specialist), getColorName(color));
+/**
+ * @brief Obsługa czerwonego w przerwie leczenia niższego koloru (SIGRTMIN)
+ *
+ * Tylko przy ścisłym priorytecie (scenarioValidate odrzuca preempt_red z EDF): czerwony
+ * ma własny mtype, więc odbiór nie zdejmuje nikogo innego i nie trzeba niczego odkładać
+ * do własnej kolejki — blokujący zwrot przy pełnej kolejce zakleszczyłby specjalność.
+ * @return czas ścienny spędzony na czerwonym — wyłączany z zajętości przerwanego leczenia
+ */
+static long long treatPreemptingRed(int spec_msgid, const SORMessage& current) {
+    SORMessage red;
+    if (msgrcv(spec_msgid, &red, sizeof(SORMessage) - sizeof(long), SPECIALIST_MTYPE_RED, IPC_NOWAIT) == -1)
+        return 0;  // Inna instancja już go podjęła
+
+    long long red_start = monotonicNs();
+    recordSpecialistWait(red, g_doctor_type, red_start);
+    __atomic_store_n(&g_state->doctor_treating[g_doctor_type][g_instance], (int)COLOR_RED, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_state->doctor_stats[g_doctor_type][g_instance].preemptions, 1, __ATOMIC_RELAXED);
+    logMessage(g_state, g_semid, "Lekarz %s przerywa badanie pacjenta %d%s — czerwony pacjent %d%s",
+              g_label, current.patient_id, childTag(current.age), red.patient_id, childTag(red.age));
+
+    int outcome;
+    {
+        RngScope rng(RNG_ROLE_TREATMENT, (uint32_t)red.patient_id);
+        randomSleep(g_scenario.p.treatment_min_ms, g_scenario.p.treatment_max_ms);
+        outcome = randomOutcome();
+    }
+    long long red_ns = monotonicNs() - red_start;
+    finishTreatment(red, outcome, red_ns);
 
-            // Wyślij do dedykowanej kolejki specjalisty (mtype koduje priorytet koloru)
-            msg.mtype = colorToMtype(color);
-            safeMsgsnd(g_state->specialist_msgids[specialist], msg, "POZ→specjalista");
+    __atomic_store_n(&g_state->doctor_treating[g_doctor_type][g_instance], current.color, __ATOMIC_RELAXED);
+    logMessage(g_state, g_semid, "Lekarz %s wznawia badanie pacjenta %d%s",
+              g_label, current.patient_id, childTag(current.age));
+    return red_ns;
+}
 
-            // Wyślij odpowiedź triażu do pacjenta
-            msg.mtype = MSG_TRIAGE_RESPONSE + msg.patient_id;
-            safeMsgsnd(g_msgid, msg, "POZ→pacjent");
+/**
+ * @brief Przejmuje czoło najdłuższej zgodnej kolejki (mtype: kolor, w nim najdłużej czekający)
+ * @return true gdy pobrano pacjenta; queue = specjalność, z której kolejki pochodzi
+ */
+static bool stealPatient(long max_mtype, SORMessage& msg, DoctorType& queue) {
+    DoctorType best = DOCTOR_POZ;
+    msgqnum_t best_depth = 0;
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (d == g_doctor_type || !g_scenario.p.doctor_enabled[d]) continue;
+        if (!(g_scenario.p.steal_mask[g_doctor_type] & (1 << d))) continue;
+        struct msqid_ds qs;
+        if (msgctl(g_state->specialist_msgids[d], IPC_STAT, &qs) == 0 && qs.msg_qnum > best_depth) {
+            best = (DoctorType)d;
+            best_depth = qs.msg_qnum;
         }
     }
+    if (best == DOCTOR_POZ) return false;
+    if (msgrcv(g_state->specialist_msgids[best], &msg, sizeof(SORMessage) - sizeof(long),
+               -max_mtype, IPC_NOWAIT) == -1)
+        return false;  // Ktoś był szybszy
+    queue = best;
+    return true;
 }
 
-// ============================================================================
-// LEKARZ SPECJALISTA
-// ============================================================================
+/**
+ * @brief Kolejny pacjent: własna kolejka; przy work_stealing i pustej własnej — najpierw
+ *        kradzież, potem blokujące czekanie (budzi je SIGRTMIN+1 od POZ)
+ *
+ * msgrcv nie ma wariantu z atomową zmianą maski sygnałów, więc SIGRTMIN+1 między
+ * sprawdzeniem g_steal a msgrcv zostałby zgubiony. Dlatego czekanie przy work_stealing
+ * przerywa też jednorazowy ITIMER_REAL (SIGALRM) po STEAL_RESCAN_MS — wywołujący
+ * dostaje EINTR i przegląda kolejki ponownie.
+ * @return false przy błędzie msgrcv (errno ustawione, EINTR przy sygnale)
+ */
+static bool receivePatient(int spec_msgid, long max_mtype, SORMessage& msg, DoctorType& queue) {
+    size_t len = sizeof(SORMessage) - sizeof(long);
+    queue = g_doctor_type;
+    if (!g_scenario.p.work_stealing) {
+        // Blokujący odbiór najmniejszego mtype: -3 → RED(1) przed YELLOW(2) przed GREEN(3),
+        // w trybie EDF -LONG_MAX → najwcześniejszy termin
+        return msgrcv(spec_msgid, &msg, len, -max_mtype, 0) != -1;
+    }
+    g_steal = 0;
+    if (msgrcv(spec_msgid, &msg, len, -max_mtype, IPC_NOWAIT) != -1) return true;
+    if (errno != ENOMSG) return false;
+    if (stealPatient(max_mtype, msg, queue)) return true;
+    if (g_steal) {  // Pobudka przyszła w trakcie przeglądania kolejek
+        errno = EINTR;
+        return false;
+    }
+    struct itimerval rescan{};
+    rescan.it_value.tv_sec = STEAL_RESCAN_MS / 1000;
+    rescan.it_value.tv_usec = (STEAL_RESCAN_MS % 1000) * 1000;
+    setitimer(ITIMER_REAL, &rescan, nullptr);
+    bool ok = msgrcv(spec_msgid, &msg, len, -max_mtype, 0) != -1;
+    int saved_errno = errno;
+    struct itimerval off{};
+    setitimer(ITIMER_REAL, &off, nullptr);  // Nie przerywać późniejszego leczenia
+    errno = saved_errno;
+    return ok;
+}
 
 static void runSpecialist() {
     int sem_idx = getSpecialistSemIndex(g_doctor_type);
     int spec_msgid = g_state->specialist_msgids[g_doctor_type];
+    long max_mtype = g_scenario.p.specialist_sched == SCHED_EDF ? LONG_MAX : SPECIALIST_MTYPE_GREEN;
 
     while (!g_shutdown && !g_state->shutdown) {
         SORMessage msg;
-
-        // Blokujący odbiór z priorytetem koloru: -3 → RED(1) przed YELLOW(2) przed GREEN(3)
-        ssize_t ret = msgrcv(spec_msgid, &msg, sizeof(SORMessage) - sizeof(long),
-                             -SPECIALIST_MTYPE_GREEN, 0);
-        if (ret == -1) {
+        DoctorType queue;
+        if (!receivePatient(spec_msgid, max_mtype, msg, queue)) {
             if (errno == EINTR) {
                 if (g_go_to_ward && !g_treating) goToWard();
                 continue;
@@ -202,27 +697,41 @@ static void runSpecialist() {
 
         semWait(g_semid, sem_idx);
         g_treating = 1;
+        long long busy_start = monotonicNs();
+        recordSpecialistWait(msg, queue, busy_start);
+        if (g_scenario.p.overload_policy == OVERLOAD_BACKPRESSURE && g_state->backlog_over[queue]) {
+            long depth = queueDepth(queue);
+            if (depth <= g_scenario.p.backlog_limit / 2) setOverloaded(queue, false, depth);  // Histereza
+        }
+        g_preempt = 0;
+        __atomic_store_n(&g_state->doctor_treating[g_doctor_type][g_instance], msg.color, __ATOMIC_RELAXED);
 
+        if (queue != g_doctor_type) {
+            __atomic_fetch_add(&g_state->doctor_stats[g_doctor_type][g_instance].stolen, 1, __ATOMIC_RELAXED);
+            logMessage(g_state, g_semid, "Lekarz %s przejmuje pacjenta %d%s z kolejki: %s",
+                      g_label, msg.patient_id, childTag(msg.age), getDoctorName(queue));
+        }
         logMessage(g_state, g_semid, "Pacjent %d%s jest badany przez lekarza %s (kolor: %s)",
-                  msg.patient_id, childTag(msg.age), getDoctorName(g_doctor_type), getColorName(msg.color));
-
-        randomSleep(TREATMENT_MIN_MS, TREATMENT_MAX_MS);
+                  msg.patient_id, childTag(msg.age), g_label, getColorName(msg.color));
 
-        int outcome = randomOutcome();
-        msg.outcome = outcome;
-
-        const char* outcome_str = (outcome >= 0 && outcome <= 2) ? OUTCOME_NAMES[outcome] : "nieznany";
-        logMessage(g_state, g_semid, "Pacjent %d%s — %s",
-                  msg.patient_id, childTag(msg.age), outcome_str);
+        int treatment_ms, outcome;
+        {
+            RngScope rng(RNG_ROLE_TREATMENT, (uint32_t)msg.patient_id);
+            treatment_ms = randomInt(g_scenario.p.treatment_min_ms, g_scenario.p.treatment_max_ms);
+            outcome = randomOutcome();
+        }
 
-        // Przydziel bilet wyjścia
-        semWait(g_semid, SEM_SHM_MUTEX);
-        msg.exit_ticket = g_state->exit_next_ticket++;
-        semSignal(g_semid, SEM_SHM_MUTEX);
+        // Leczenie w kawałkach: SIGRTMIN wstrzymuje je na czas czerwonego, potem reszta czasu
+        long long remaining_ns = (long long)(treatment_ms * 1000000.0 / g_time_scale);
+        long long preempted_ns = 0;
+        while (remaining_ns > 0 && (remaining_ns = treatmentSleep(remaining_ns)) > 0) {
+            g_preempt = 0;
+            if (msg.color != COLOR_RED) preempted_ns += treatPreemptingRed(spec_msgid, msg);
+        }
 
-        msg.mtype = MSG_SPECIALIST_RESPONSE + msg.patient_id;
-        safeMsgsnd(g_msgid, msg, getDoctorName(g_doctor_type));
+        finishTreatment(msg, outcome, monotonicNs() - busy_start - preempted_ns);
 
+        __atomic_store_n(&g_state->doctor_treating[g_doctor_type][g_instance], (int)COLOR_NONE, __ATOMIC_RELAXED);
         g_treating = 0;
         semSignal(g_semid, sem_idx);
 
@@ -236,7 +745,7 @@ static void runSpecialist() {
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Użycie: lekarz <typ>\n");
+        fprintf(stderr, "Użycie: lekarz <typ> [instancja]\n");
         return EXIT_FAILURE;
     }
 
@@ -246,24 +755,43 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    // Opóźnienie startowe (POZ i specjaliści niezależnie)
+    initIPC();
+    setupSignals();
+
+    if (argc >= 3) g_instance = atoi(argv[2]);
+    if (g_instance < 0 || g_instance >= maxDoctorStaff(g_scenario.p, g_doctor_type)) {
+        fprintf(stderr, "Nieprawidłowa instancja lekarza %s: %d\n", getDoctorName(g_doctor_type), g_instance);
+        return EXIT_FAILURE;
+    }
+    if (maxDoctorStaff(g_scenario.p, g_doctor_type) > 1)
+        snprintf(g_label, sizeof(g_label), "%s #%d", getDoctorName(g_doctor_type), g_instance + 1);
+    else
+        snprintf(g_label, sizeof(g_label), "%s", getDoctorName(g_doctor_type));
+
+    // Opóźnienie startowe (POZ i specjaliści niezależnie, w czasie symulacji)
     if (g_doctor_type == DOCTOR_POZ) {
         if constexpr (STARTUP_DELAY_POZ_MS > 0) msleep(STARTUP_DELAY_POZ_MS);
     } else {
         if constexpr (STARTUP_DELAY_SPECIALIST_MS > 0) msleep(STARTUP_DELAY_SPECIALIST_MS);
     }
 
-    initIPC();
-    setupSignals();
-
-    logMessage(g_state, g_semid, "Lekarz %s rozpoczyna pracę", getDoctorName(g_doctor_type));
+    logMessage(g_state, g_semid, "Lekarz %s rozpoczyna pracę", g_label);
+    signalReady(g_semid);
 
-    if (g_doctor_type == DOCTOR_POZ)
+    if (g_doctor_type == DOCTOR_POZ) {
+        if (g_scenario.p.registry_enabled) registryOpen(g_registry, g_semid);
         runPOZ();
-    else
+        registryClose(g_registry);
+    } else {
+        // Instancja z autoskalowania wnosi własne miejsce w SEM_SPECIALIST_* i zabiera je przy wycofaniu
+        bool extra = g_instance >= g_scenario.p.doctor_staff[g_doctor_type];
+        int sem_idx = getSpecialistSemIndex(g_doctor_type);
+        if (extra) semSignal(g_semid, sem_idx);
         runSpecialist();
+        if (extra && !g_state->shutdown) semWait(g_semid, sem_idx);
+    }
 
-    logMessage(g_state, g_semid, "Lekarz %s kończy pracę", getDoctorName(g_doctor_type));
+    logMessage(g_state, g_semid, "Lekarz %s kończy pracę", g_label);
     shmdt(g_state);
     return 0;
 }
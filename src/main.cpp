@@ -1,11 +1,26 @@
 /**
  * @file main.cpp
  * @brief Proces dyrektora SOR — IPC init, spawn procesów, klawiatura, cleanup
+ *
+ * Pętla zdarzeń oparta o jeden epoll: stdin (klawiatura), timerfd (limit -t),
+ * signalfd (SIGINT/SIGTERM/SIGHUP) oraz pidfd każdego procesu potomnego.
+ * Dyrektor nie odpytuje niczego cyklicznie — budzi się tylko na zdarzenie.
+ *
+ * Opcjonalne rozmieszczenie na CPU (-a): rejestracja, POZ i każdy specjalista
+ * przypięci (sched_setaffinity) do wybranych rdzeni / węzła NUMA, generator
+ * i jego pacjenci ograniczeni do pozostałych rdzeni.
  */
 
 #include "sor_common.hpp"
+#include "sor_scenario.hpp"
+#include "sor_ward.hpp"
 #include <termios.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#include <climits>
 
 // ============================================================================
 // ZMIENNE GLOBALNE
@@ -22,10 +37,82 @@ static int g_max_time = 0;        // 0 = bez limitu
 static int g_max_patients = 0;    // 0 = bez limitu
 static int g_gen_min_ms = 0;      // 0 = domyślny z sor_common.hpp
 static int g_gen_max_ms = 0;
-
-static std::vector<pid_t> g_child_pids;
+static const char* g_trace_path = nullptr;    // -T: ślad przyjęć dla generatora
+static const char* g_profile_path = nullptr;  // -R: profil intensywności napływu
+static double g_admit_rate = 0.0;  // -b: wiadro żetonów przyjęć [pacjentów/s], 0 = wyłączone
+static int g_admit_burst = 1;
+static double g_time_scale_arg = 1.0;  // -x: przyspieszenie czasu symulacji
+static unsigned long long g_seed_arg = 0;  // -s: ziarno strumieni losowych, 0 = losowe
+static const char* g_scenario_path = nullptr;  // -c: plik scenariusza (nadpisuje stałe z sor_common.hpp)
+static bool g_drain_on_timeout = false; // -d: po upływie -t drenaż zamiast natychmiastowego końca
+static const char* g_placement_arg = nullptr;  // -a: auto | lista CPU | node:<n>
+
+/// Plan rozmieszczenia ról na CPU (wypełniany przez planPlacement)
+struct Placement {
+    bool enabled;
+    std::vector<cpu_set_t> role_sets;  // Kolejno: rejestracja, POZ, specjaliści (tylko włączeni)
+    size_t next_role;                  // Następny slot przydzielany przy fork
+    cpu_set_t generator_set;           // Generator + pacjenci (dziedziczą przez fork)
+};
+static Placement g_placement{};
+
+/// Wyszukiwanie punktu nasycenia (-S start:krok:sekundy)
+struct SweepStep {
+    double offered;        // Zadana intensywność [pacjentów/s]
+    double throughput;     // Wyjścia z SOR w kroku [pacjentów/s]
+    double sojourn_avg_s;  // Średni czas pobytu pacjentów, którzy wyszli w kroku
+    double sojourn_max_s;
+    double stage_avg_s[HANDOFF_COUNT];  // Średni czas etapu: rejestracja, triaż, specjalista
+    int in_system;         // Pacjenci w systemie na końcu kroku
+    int reg_queue;         // Kolejka rejestracji na końcu kroku
+};
+struct Sweep {
+    bool enabled;
+    double start, step;            // [pacjentów/s]
+    int step_s;                    // Długość kroku w sekundach symulacji
+    int timerfd;
+    long long last_completed;
+    long long last_count, last_sum_ns;
+    long long last_stage_count[HANDOFF_COUNT], last_stage_sum_ns[HANDOFF_COUNT];
+    int last_in_system;
+    int saturated_steps;           // Kolejne kroki bez nadążania za napływem
+    bool saturated;                // Kolano znalezione (także już przy starcie)
+    double saturation_rate;        // Ostatni nadążający krok; < start = nasycony od startu
+    std::vector<SweepStep> steps;
+};
+static Sweep g_sweep{};
+constexpr double SWEEP_TRACK_RATIO = 0.9;   // Nadąża: przepustowość >= 90% napływu
+constexpr int SWEEP_KNEE_STEPS = 2;         // Tyle kolejnych kroków bez nadążania = kolano
+constexpr const char* SWEEP_CSV = "sor_nasycenie.csv";
+
+/// Proces potomny dyrektora + jego pidfd (czytelny w epoll gdy proces się zakończy)
+struct ChildProc {
+    pid_t pid;     // 0 = już zebrany (waitpid)
+    int pidfd;     // -1 = brak pidfd (jądro < 5.3)
+    bool retired;  // Wycofany przez autoskalowanie — zakończenie oczekiwane
+};
+
+static std::vector<ChildProc> g_children;
 static pid_t g_generator_pid = -1;
 
+// Deskryptory pętli zdarzeń
+static int g_epfd = -1;
+static int g_sigfd = -1;
+static int g_timerfd = -1;
+static bool g_stdin_watched = false;
+constexpr int READY_TIMEOUT_MS = 10000;  // Limit bariery startowej (zegar ścienny)
+static sigset_t g_orig_sigmask;         // Maska sprzed blokady — przywracana w dzieciach
+
+// Tagi epoll_event.data.u64 (dzieci: EV_CHILD_BASE + indeks w g_children)
+constexpr uint64_t EV_STDIN      = 1;
+constexpr uint64_t EV_SIGNAL     = 2;
+constexpr uint64_t EV_TIMER      = 3;
+constexpr uint64_t EV_SWEEP      = 4;
+constexpr uint64_t EV_AUTOSCALE  = 5;
+constexpr uint64_t EV_BREAKS     = 6;
+constexpr uint64_t EV_WARDS      = 7;
+constexpr uint64_t EV_CHILD_BASE = 0x100;
+
 static struct termios g_orig_termios;
 static bool g_termios_set = false;
 
@@ -36,11 +123,22 @@ static inline bool shouldStop() { return g_shutdown || (g_state && g_state->shut
 // ============================================================================
 
 static void printUsage(const char* prog) {
-    fprintf(stderr, "Użycie: %s [-t sekundy] [-p maks_procesów] [-g min_ms max_ms]\n", prog);
-    fprintf(stderr, "  -t <s>        Czas trwania symulacji w sekundach (domyślnie: bez limitu)\n");
+    fprintf(stderr, "Użycie: %s [-t sekundy] [-d] [-p maks_procesów] [-b tempo:wiadro]\n"
+                    "       [-g min_ms max_ms | -T ślad | -R profil | -S start:krok:s] [-x współczynnik] [-a plan_cpu]\n"
+                    "       [-s ziarno] [-c scenariusz]\n", prog);
+    fprintf(stderr, "  -t <s>        Czas trwania symulacji w sekundach symulacji (domyślnie: bez limitu)\n");
+    fprintf(stderr, "  -d            Po upływie -t drenaż (koniec przyjęć, obecni pacjenci kończą wizytę)\n");
     fprintf(stderr, "  -p <n>        Maks jednoczesnych procesów łącznie (domyślnie: bez limitu)\n");
+    fprintf(stderr, "  -b <r:n>      Limit przyjęć: wiadro żetonów r pacjentów/s, do n naraz (domyślnie: brak)\n");
     fprintf(stderr, "  -g <min> <max> Czas między generowaniem pacjentów w ms (domyślnie: %d-%d)\n",
             PATIENT_GEN_MIN_MS, PATIENT_GEN_MAX_MS);
+    fprintf(stderr, "  -T <plik>     Ślad przyjęć: linie \"czas_ms wiek [vip]\" odtwarzane od startu generatora\n");
+    fprintf(stderr, "  -R <plik>     Profil napływu: linie \"od_s pacjentów_na_s\" (proces Poissona, stała w odcinku)\n");
+    fprintf(stderr, "  -S <a:b:s>    Szukanie nasycenia: napływ od a/s, +b/s co s sekund (domyślnie 30) aż do kolana\n");
+    fprintf(stderr, "  -a <plan>     Przypięcie ról do CPU: auto | lista np. 0,2,4-6 | node:<n> (domyślnie: brak)\n");
+    fprintf(stderr, "  -x <f>        Przyspieszenie czasu symulacji, np. 10 = 10x szybciej (domyślnie: 1)\n");
+    fprintf(stderr, "  -c <plik>     Scenariusz: linie \"klucz = wartość\" (np. triage_red_pm, treatment_max_ms, n)\n");
+    fprintf(stderr, "  -s <n>        Ziarno losowania: to samo ziarno = te same decyzje per pacjent (domyślnie: losowe)\n");
     exit(EXIT_FAILURE);
 }
 
@@ -67,6 +165,38 @@ static int createOrderQueue(key_t key, const char* name) {
     return qid;
 }
 
+/**
+ * @brief overload_policy: kolejki specjalistów muszą pomieścić backlog_limit pacjentów
+ *
+ * Przy wyłączonej polityce nic nie zmienia. Próbuje podnieść msg_qbytes (IPC_SET) do
+ * 2 × backlog_limit wiadomości — zapas na czerwonych i żółtych ponad limit; bez
+ * CAP_SYS_RESOURCE jądro nie pozwala przekroczyć msgmnb. Gdy limit nadal nie mieści się
+ * w kolejce, obcina backlog_limit do jej pojemności (g_scenario trafia potem do SHM).
+ */
+static void fitSpecialistQueues() {
+    if (g_scenario.p.overload_policy == OVERLOAD_NONE) return;
+    const size_t msg_size = sizeof(SORMessage) - sizeof(long);
+    long capacity = LONG_MAX;
+    for (int i = DOCTOR_KARDIOLOG; i <= DOCTOR_PEDIATRA; i++) {
+        struct msqid_ds qs;
+        int qid = g_state->specialist_msgids[i];
+        if (msgctl(qid, IPC_STAT, &qs) == -1) SOR_FATAL("msgctl IPC_STAT — %s", getDoctorName((DoctorType)i));
+        msglen_t wanted = (msglen_t)(2 * (size_t)g_scenario.p.backlog_limit * msg_size);
+        if (qs.msg_qbytes < wanted) {
+            qs.msg_qbytes = wanted;
+            if (msgctl(qid, IPC_SET, &qs) == -1) msgctl(qid, IPC_STAT, &qs);  // EPERM: zostaje msgmnb
+        }
+        long fits = (long)(qs.msg_qbytes / msg_size);
+        if (fits < capacity) capacity = fits;
+    }
+    if (g_scenario.p.backlog_limit > capacity) {
+        errno = 0;
+        SOR_WARN("backlog_limit=%d przekracza pojemność kolejki specjalisty (%ld pacjentów) — obcięty",
+                 g_scenario.p.backlog_limit, capacity);
+        g_scenario.p.backlog_limit = (int)capacity;
+    }
+}
+
 static void initIPC() {
     // --- PAMIĘĆ DZIELONA ---
     key_t shm_key = getIPCKey(SHM_KEY_ID);
@@ -91,9 +221,15 @@ static void initIPC() {
 
     unsigned short sem_values[SEM_COUNT] = {0};
     for (int i = SEM_SPECIALIST_KARDIOLOG; i <= SEM_SPECIALIST_PEDIATRA; i++)
-        sem_values[i] = 1;
+        sem_values[i] = g_scenario.p.doctor_staff[i + 1];  // Tylu pacjentów naraz, ilu lekarzy
     sem_values[SEM_SHM_MUTEX] = 1;
     sem_values[SEM_LOG_MUTEX] = 1;
+    sem_values[SEM_REGISTRY] = 1;
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++)   // Wolne łóżka (zajęte na starcie: armWards)
+        sem_values[getWardSemIndex((DoctorType)d)] =
+            g_scenario.p.ward_beds[d] - g_scenario.p.ward_beds[d] * g_scenario.p.ward_initial_pct / 100;
+    if (g_max_patients > 0)   // Pula miejsc na procesy pacjentów (limit -p minus procesy stałe)
+        sem_values[SEM_ADMISSION] = g_max_patients - fixedProcessCount(g_scenario.p);
 
     union semun { int val; struct semid_ds *buf; unsigned short *array; } arg;
     arg.array = sem_values;
@@ -104,20 +240,31 @@ static void initIPC() {
     g_state->gate_msgid = gate_msgid;
 
     GateToken token{};
-    for (int i = 1; i <= N; i++) {
+    for (int i = 1; i <= g_scenario.p.waiting_capacity; i++) {
         token.mtype = i;
         if (msgsnd(gate_msgid, &token, GATE_TOKEN_SIZE, 0) == -1)
             SOR_FATAL("msgsnd gate token %d", i);
     }
     g_state->gate_next_ticket = 1;
-    g_state->gate_now_serving = N + 1;
+    g_state->gate_now_serving = g_scenario.p.waiting_capacity + 1;
     g_state->triage_next_ticket = 1;
+    g_state->triage_dispatch_next = 1;
     g_state->exit_next_ticket = 1;
 
     // --- KOLEJKI PORZĄDKUJĄCE ---
     g_state->order_gate_log_msgid = createOrderQueue(getOrderGateLogKey(), "gate_log");
-    g_state->order_triage_msgid   = createOrderQueue(getOrderTriageKey(), "triage");
     g_state->order_exit_msgid     = createOrderQueue(getOrderExitKey(), "exit");
+    g_state->order_board_msgid    = createQueue(getOrderBoardKey(), "board");
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) {
+        GateToken seed{};
+        seed.mtype = wardBoardMtype((DoctorType)d, 1);
+        g_state->ward_board_next_ticket[d] = 1;
+        if (msgsnd(g_state->order_board_msgid, &seed, GATE_TOKEN_SIZE, 0) == -1)
+            SOR_FATAL("msgsnd seed kolejki board (%s)", getWardName((DoctorType)d));
+    }
+
+    // --- KOLEJKA WEJŚCIOWA TRIAŻU (bez tokenu — porządek wyznacza bilet w mtype) ---
+    g_state->triage_msgid = createQueue(getTriageQueueKey(), "triaż");
 
     // --- KOLEJKA KOMUNIKATÓW ---
     g_msgid = createQueue(getIPCKey(MSG_KEY_ID), "komunikaty");
@@ -129,8 +276,9 @@ static void initIPC() {
         g_state->specialist_msgids[dtype] = createQueue(
             getSpecialistQueueKey(dtype), getDoctorName(dtype));
     }
+    fitSpecialistQueues();
 
-    printf("IPC zainicjalizowane: SHM=%d, SEM=%d, MSG=%d + 6 kolejek specjalistów + 4 kolejki porządkujące\n",
+    printf("IPC zainicjalizowane: SHM=%d, SEM=%d, MSG=%d + kolejka triażu + 6 kolejek specjalistów + 2 kolejki porządkujące\n",
            g_shmid, g_semid, g_msgid);
 }
 
@@ -151,76 +299,294 @@ static void cleanupIPC() {
     for (int i = DOCTOR_KARDIOLOG; i <= DOCTOR_PEDIATRA; i++)
         removeQueue(getSpecialistQueueKey((DoctorType)i));
     removeQueue(getOrderGateLogKey());
-    removeQueue(getOrderTriageKey());
+    removeQueue(getTriageQueueKey());
     removeQueue(getOrderExitKey());
+    removeQueue(getOrderBoardKey());
 
     printf("Zasoby IPC usunięte\n");
 }
 
+// ============================================================================
+// ROZMIESZCZENIE NA CPU (-a)
+// ============================================================================
+
+/// Parsuje listę CPU w formacie jądra: "0,2,4-6"
+static bool parseCpuList(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo >= CPU_SETSIZE) return false;
+        long hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo || hi >= CPU_SETSIZE) return false;
+        }
+        for (long c = lo; c <= hi; c++) CPU_SET(c, set);
+        p = end;
+        if (*p == ',') p++;
+        else if (*p == '\n' || *p == '\0') break;
+        else return false;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/// Czyta CPU węzła NUMA z /sys (open/read — niskopoziomowe I/O)
+static bool readNodeCpus(int node, cpu_set_t* set) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) return false;
+    buf[n] = '\0';
+    return parseCpuList(buf, set);
+}
+
+static std::string cpuSetToString(const cpu_set_t* set) {
+    std::string out;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (!CPU_ISSET(c, set)) continue;
+        if (!out.empty()) out += ",";
+        out += std::to_string(c);
+    }
+    return out.empty() ? "-" : out;
+}
+
+/// Układa plan: każda rola na własnym rdzeniu (auto / lista) albo na całym węźle (node:N);
+/// generator na rdzeniach, których nie dostała żadna rola.
+static void planPlacement(const char* prog) {
+    if (!g_placement_arg) return;
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) SOR_FATAL("sched_getaffinity");
+
+    int roles = 1 + doctorProcessCount(g_scenario.p);
+    cpu_set_t used;
+    CPU_ZERO(&used);
+
+    if (strncmp(g_placement_arg, "node:", 5) == 0) {
+        char* end;
+        long node = strtol(g_placement_arg + 5, &end, 10);
+        cpu_set_t node_cpus;
+        if (end == g_placement_arg + 5 || *end != '\0' || node < 0 || !readNodeCpus((int)node, &node_cpus)) {
+            fprintf(stderr, "Błąd: -a %s — nie można odczytać CPU węzła NUMA\n", g_placement_arg);
+            printUsage(prog);
+        }
+        CPU_AND(&used, &node_cpus, &allowed);
+        if (CPU_COUNT(&used) == 0) {
+            fprintf(stderr, "Błąd: -a %s — węzeł nie ma dozwolonych CPU\n", g_placement_arg);
+            printUsage(prog);
+        }
+        g_placement.role_sets.assign(roles, used);
+    } else {
+        cpu_set_t chosen;
+        if (strcmp(g_placement_arg, "auto") == 0) {
+            chosen = allowed;
+        } else if (!parseCpuList(g_placement_arg, &chosen)) {
+            fprintf(stderr, "Błąd: -a '%s' — oczekiwano auto, listy CPU (np. 0,2,4-6) lub node:<n>\n",
+                    g_placement_arg);
+            printUsage(prog);
+        }
+
+        std::vector<int> cores;
+        for (int c = 0; c < CPU_SETSIZE && (int)cores.size() < roles; c++) {
+            if (!CPU_ISSET(c, &chosen)) continue;
+            if (!CPU_ISSET(c, &allowed)) {
+                fprintf(stderr, "Błąd: -a — CPU %d niedostępny dla procesu\n", c);
+                printUsage(prog);
+            }
+            cores.push_back(c);
+        }
+        if (cores.empty()) {
+            fprintf(stderr, "Błąd: -a '%s' — pusta lista CPU\n", g_placement_arg);
+            printUsage(prog);
+        }
+        for (int i = 0; i < roles; i++) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cores[i % cores.size()], &one);   // Mniej rdzeni niż ról → dzielenie po kolei
+            CPU_SET(cores[i % cores.size()], &used);
+            g_placement.role_sets.push_back(one);
+        }
+    }
+
+    // Generator i pacjenci: pozostałe rdzenie (allowed \ used)
+    CPU_ZERO(&g_placement.generator_set);
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed) && !CPU_ISSET(c, &used)) CPU_SET(c, &g_placement.generator_set);
+    if (CPU_COUNT(&g_placement.generator_set) == 0) {
+        fprintf(stderr, "Uwaga: -a — brak wolnych rdzeni dla generatora/pacjentów, dzielą wszystkie CPU\n");
+        g_placement.generator_set = allowed;
+    }
+    g_placement.enabled = true;
+}
+
+/// Następny zestaw CPU dla roli (nullptr gdy -a nie podano)
+static const cpu_set_t* nextRoleCpus() {
+    if (!g_placement.enabled || g_placement.role_sets.empty()) return nullptr;
+    const cpu_set_t* set = &g_placement.role_sets[g_placement.next_role % g_placement.role_sets.size()];
+    g_placement.next_role++;
+    return set;
+}
+
+static void logPlacement(pid_t pid, const char* role, const cpu_set_t* cpus) {
+    if (!cpus) return;
+    logMessage(g_state, g_semid, "[Dyrektor] %s (PID %d) przypięty do CPU %s",
+              role, pid, cpuSetToString(cpus).c_str());
+}
+
 // ============================================================================
 // URUCHAMIANIE PROCESÓW
 // ============================================================================
 
+static long long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int pidfdOpen(pid_t pid) {
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+/// Wywoływane w dziecku po fork(): PDEATHSIG + przywrócenie maski sygnałów
+/// (dyrektor blokuje SIGINT/SIGTERM/SIGHUP dla signalfd, a maska dziedziczy się przez exec)
+/// oraz przypięcie do CPU wg planu -a (affinity przetrwa exec)
+static void childPrologue(const cpu_set_t* cpus) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    sigprocmask(SIG_SETMASK, &g_orig_sigmask, nullptr);
+    if (cpus && sched_setaffinity(0, sizeof(cpu_set_t), cpus) == -1)
+        SOR_WARN("sched_setaffinity");
+}
+
+/// Dodaje proces potomny do listy i rejestruje jego pidfd w epoll
+static void registerChild(pid_t pid) {
+    ChildProc child{pid, pidfdOpen(pid), false};
+    if (child.pidfd == -1) {
+        SOR_WARN("pidfd_open PID=%d — zakończenie procesu nie będzie wykrywane", pid);
+    } else {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = EV_CHILD_BASE + g_children.size();
+        if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, child.pidfd, &ev) == -1)
+            SOR_WARN("epoll_ctl ADD pidfd PID=%d", pid);
+    }
+    g_children.push_back(child);
+}
+
 static void startRegistration() {
+    const cpu_set_t* cpus = nextRoleCpus();
     pid_t pid = fork();
     if (pid == 0) {
-        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        childPrologue(cpus);
         execl("./rejestracja", "rejestracja", nullptr);
         SOR_FATAL("execl rejestracja");
     } else if (pid > 0) {
         g_state->registration_pid = pid;
-        g_child_pids.push_back(pid);
+        registerChild(pid);
+        logPlacement(pid, "Rejestracja", cpus);
     } else {
         SOR_FATAL("fork rejestracja");
     }
 }
 
+/// Uruchamia instancję lekarza (typ, numer w obsadzie) — przy starcie i z autoskalowania
+static pid_t spawnDoctor(int type, int inst, const cpu_set_t* cpus) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        childPrologue(cpus);
+        char type_str[16], inst_str[16];
+        snprintf(type_str, sizeof(type_str), "%d", type);
+        snprintf(inst_str, sizeof(inst_str), "%d", inst);
+        execl("./lekarz", "lekarz", type_str, inst_str, nullptr);
+        SOR_FATAL("execl lekarz typ=%d", type);
+    } else if (pid > 0) {
+        g_state->doctor_pids[type][inst] = pid;
+        registerChild(pid);
+    } else {
+        SOR_WARN("fork lekarz typ=%d", type);
+    }
+    return pid;
+}
+
 static void startDoctors() {
     for (int i = 0; i < DOCTOR_COUNT; i++) {
-        if (!DOCTOR_ENABLED[i]) {
-            g_state->doctor_pids[i] = 0;
+        if (!g_scenario.p.doctor_enabled[i]) {
             logMessage(g_state, g_semid, "[Dyrektor] Lekarz %s WYŁĄCZONY — pomijam",
                       getDoctorName((DoctorType)i));
             continue;
         }
 
-        pid_t pid = fork();
-        if (pid == 0) {
-            prctl(PR_SET_PDEATHSIG, SIGTERM);
-            char type_str[16];
-            snprintf(type_str, sizeof(type_str), "%d", i);
-            execl("./lekarz", "lekarz", type_str, nullptr);
-            SOR_FATAL("execl lekarz typ=%d", i);
-        } else if (pid > 0) {
-            g_state->doctor_pids[i] = pid;
-            g_child_pids.push_back(pid);
-        } else {
-            SOR_FATAL("fork lekarz typ=%d", i);
+        // Instancje jednej specjalności czytają tę samą kolejkę specjalisty
+        for (int inst = 0; inst < g_scenario.p.doctor_staff[i]; inst++) {
+            const cpu_set_t* cpus = nextRoleCpus();
+            pid_t pid = spawnDoctor(i, inst, cpus);
+            if (pid == -1) SOR_FATAL("fork lekarz typ=%d", i);
+            logPlacement(pid, getDoctorName((DoctorType)i), cpus);
         }
     }
 }
 
 static void startGenerator() {
+    const cpu_set_t* cpus = g_placement.enabled ? &g_placement.generator_set : nullptr;
     pid_t pid = fork();
     if (pid == 0) {
-        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        childPrologue(cpus);
+        // generator [-T ślad] [-R profil] [min_ms max_ms]
+        char min_str[16], max_str[16];
+        const char* args[8];
+        int n = 0;
+        args[n++] = "generator";
+        if (g_trace_path)   { args[n++] = "-T"; args[n++] = g_trace_path; }
+        if (g_profile_path) { args[n++] = "-R"; args[n++] = g_profile_path; }
         if (g_gen_min_ms > 0) {
-            char min_str[16], max_str[16];
             snprintf(min_str, sizeof(min_str), "%d", g_gen_min_ms);
             snprintf(max_str, sizeof(max_str), "%d", g_gen_max_ms);
-            execl("./generator", "generator", min_str, max_str, nullptr);
-        } else {
-            execl("./generator", "generator", nullptr);
+            args[n++] = min_str;
+            args[n++] = max_str;
         }
-        SOR_FATAL("execl generator");
+        args[n] = nullptr;
+        execv("./generator", (char* const*)args);
+        SOR_FATAL("execv generator");
     } else if (pid > 0) {
-        g_child_pids.push_back(pid);
+        registerChild(pid);
         g_generator_pid = pid;
+        logPlacement(pid, "Generator + pacjenci", cpus);
     } else {
         SOR_FATAL("fork generator");
     }
 }
 
+/// Bariera startowa: czeka aż rejestracja i wszyscy lekarze zgłoszą SEM_READY
+static void waitForRoles() {
+    int expected = 1 + doctorProcessCount(g_scenario.p);
+    long long t0 = monotonicMs();
+
+    struct sembuf op{};
+    op.sem_num = SEM_READY;
+    op.sem_op  = -expected;            // Jedna operacja: wszystkie role naraz
+    op.sem_flg = 0;
+    struct timespec timeout = {READY_TIMEOUT_MS / 1000, (READY_TIMEOUT_MS % 1000) * 1000000L};
+
+    while (semtimedop(g_semid, &op, 1, &timeout) == -1) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) {
+            SOR_WARN("bariera startowa: gotowych %d/%d ról po %d ms — startuję generator mimo to",
+                     semGetValue(g_semid, SEM_READY), expected, READY_TIMEOUT_MS);
+        } else {
+            SOR_WARN("semtimedop SEM_READY");
+        }
+        return;
+    }
+    logMessage(g_state, g_semid, "[Dyrektor] Wszystkie role gotowe (%d/%d) po %lld ms — start generatora",
+              expected, expected, monotonicMs() - t0);
+}
+
 // ============================================================================
 // TERMINAL
 // ============================================================================
@@ -232,8 +598,8 @@ static void setRawTerminal() {
 
     struct termios raw = g_orig_termios;
     raw.c_lflag &= ~(ICANON | ECHO);
-    raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;
+    raw.c_cc[VMIN] = 1;     // epoll zgłasza gotowość — read() nigdy nie czeka
+    raw.c_cc[VTIME] = 0;
     tcsetattr(STDIN_FILENO, TCSANOW, &raw);
 }
 
@@ -246,89 +612,834 @@ static void restoreTerminal() {
 // OBSŁUGA KLAWIATURY
 // ============================================================================
 
-static void handleKeyboard() {
-    printf("\nCzekam na komendy (1-6: lekarz na oddział, 7: ewakuacja, q: wyjście)...\n\n");
+/// Drenaż: generator przestaje przyjmować, kończy gdy ostatni pacjent wyjdzie (pidfd)
+static void startDrain() {
+    if (g_state->draining) return;
+    printf("Drenaż: wstrzymuję przyjęcia, czekam aż pacjenci opuszczą SOR...\n");
+    logMessage(g_state, g_semid, "[Dyrektor] Drenaż — koniec przyjęć, pacjenci w SOR kończą wizytę");
+    g_state->draining = 1;
+    if (g_generator_pid <= 0) {     // Generator już nie żyje — nie ma na co czekać
+        g_state->shutdown = 1;
+        g_shutdown = 1;
+    }
+}
 
-    while (!shouldStop()) {
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(STDIN_FILENO, &fds);
-
-        struct timeval tv = {0, 100000};  // 100ms
-        int ret = select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &tv);
-
-        if (ret > 0 && FD_ISSET(STDIN_FILENO, &fds)) {
-            char c;
-            if (read(STDIN_FILENO, &c, 1) != 1) continue;
-
-            if (c >= '1' && c <= '6') {
-                DoctorType dtype = (DoctorType)(c - '0');
-                pid_t doctor_pid = g_state->doctor_pids[dtype];
-                if (doctor_pid > 0) {
-                    printf("Wysyłam SIGUSR1 do lekarza: %s (PID %d)\n",
-                           getDoctorName(dtype), doctor_pid);
-                    logMessage(g_state, g_semid, "[SIGUSR1] Lekarz %s wysłany na oddział",
-                              getDoctorName(dtype));
-                    if (kill(doctor_pid, SIGUSR1) == -1)
-                        SOR_WARN("kill SIGUSR1 do lekarza PID=%d", doctor_pid);
-                }
-            } else if (c == '7') {
-                printf("EWAKUACJA! Wysyłam SIGUSR2 do wszystkich...\n");
-                logMessage(g_state, g_semid, "[SIGUSR2] EWAKUACJA - zakończenie symulacji");
-                g_state->shutdown = 1;
-                for (pid_t pid : g_child_pids)
-                    if (pid > 0) kill(pid, SIGUSR2);
-                g_shutdown = 1;
-                break;
-            } else if (c == 'q' || c == 'Q') {
-                printf("Zamykanie symulacji...\n");
-                g_state->shutdown = 1;
-                g_shutdown = 1;
+static void handleKey(char c) {
+    if (c >= '1' && c <= '6') {
+        DoctorType dtype = (DoctorType)(c - '0');
+        // Przy kilku instancjach na oddział idzie pierwsza, która nie jest już na przerwie;
+        // #1 tylko gdy wszystkie są poza stanowiskiem
+        int inst = 0;
+        for (int i = 0; i < DOCTOR_MAX_INSTANCES; i++) {
+            if (g_state->doctor_pids[dtype][i] > 0 && !g_state->doctor_on_break[dtype][i]) {
+                inst = i;
                 break;
             }
         }
+        pid_t doctor_pid = g_state->doctor_pids[dtype][inst];
+        if (doctor_pid > 0) {
+            printf("Wysyłam SIGUSR1 do lekarza: %s #%d (PID %d)\n",
+                   getDoctorName(dtype), inst + 1, doctor_pid);
+            logMessage(g_state, g_semid, "[SIGUSR1] Lekarz %s wysłany na oddział",
+                      getDoctorName(dtype));
+            if (kill(doctor_pid, SIGUSR1) == -1)
+                SOR_WARN("kill SIGUSR1 do lekarza PID=%d", doctor_pid);
+        }
+    } else if (c == '7') {
+        printf("EWAKUACJA! Wysyłam SIGUSR2 do wszystkich...\n");
+        logMessage(g_state, g_semid, "[SIGUSR2] EWAKUACJA - zakończenie symulacji");
+        g_state->shutdown = 1;
+        for (const ChildProc& child : g_children)
+            if (child.pid > 0) kill(child.pid, SIGUSR2);
+        g_shutdown = 1;
+    } else if (c == 'd' || c == 'D') {
+        startDrain();
+    } else if (c == 'q' || c == 'Q') {
+        printf("Zamykanie symulacji...\n");
+        g_state->shutdown = 1;
+        g_shutdown = 1;
+    }
+}
+
+// ============================================================================
+// PĘTLA ZDARZEŃ (epoll)
+// ============================================================================
+
+static void epollAdd(int fd, uint64_t tag) {
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = tag;
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        SOR_FATAL("epoll_ctl ADD fd=%d", fd);
+}
+
+/// Tworzy epoll + signalfd (przed fork — dzieci przywracają maskę w childPrologue)
+static void initEventLoop() {
+    g_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (g_epfd == -1) SOR_FATAL("epoll_create1");
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, &g_orig_sigmask) == -1) SOR_FATAL("sigprocmask");
+
+    g_sigfd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+    if (g_sigfd == -1) SOR_FATAL("signalfd");
+    epollAdd(g_sigfd, EV_SIGNAL);
+}
+
+/// Uzbraja timerfd na koniec symulacji: start + max_time/time_scale (zegar ścienny)
+static void armTimeLimit() {
+    if (g_max_time <= 0) return;
+
+    g_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (g_timerfd == -1) SOR_FATAL("timerfd_create");
+
+    long long wall_ns = (long long)(g_max_time * 1e9 / g_time_scale_arg);
+    long long end_ns  = (long long)g_state->start_time_sec * 1000000000LL +
+                        g_state->start_time_nsec + wall_ns;
+    struct itimerspec its{};
+    its.it_value.tv_sec  = end_ns / 1000000000LL;
+    its.it_value.tv_nsec = end_ns % 1000000000LL;
+    if (timerfd_settime(g_timerfd, TFD_TIMER_ABSTIME, &its, nullptr) == -1)
+        SOR_FATAL("timerfd_settime");
+    epollAdd(g_timerfd, EV_TIMER);
+}
+
+static void watchStdin() {
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = EV_STDIN;
+    if (epoll_ctl(g_epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0)
+        g_stdin_watched = true;   // /dev/null lub zwykły plik nie obsługują epoll — wtedy bez klawiatury
+}
+
+static void unwatchStdin() {
+    if (!g_stdin_watched) return;
+    epoll_ctl(g_epfd, EPOLL_CTL_DEL, STDIN_FILENO, nullptr);
+    g_stdin_watched = false;
+}
+
+/// Zbiera zakończony proces (pidfd czytelny) — bez blokowania
+static void reapChild(size_t idx) {
+    ChildProc& child = g_children[idx];
+    if (child.pid <= 0) return;
+
+    int status = 0;
+    if (waitpid(child.pid, &status, WNOHANG) <= 0) return;  // Jeszcze żyje (fałszywy alarm)
 
-        // Timeout symulacji
-        if (g_max_time > 0 && getElapsedTime(g_state) >= g_max_time) {
-            printf("\nCzas symulacji (%d s) upłynął — zamykanie...\n", g_max_time);
-            logMessage(g_state, g_semid, "[Dyrektor] Timeout %d s — zamykanie symulacji", g_max_time);
+    bool expected = shouldStop() || child.retired || (g_state->draining && child.pid == g_generator_pid);
+    if (!expected) {
+        logMessage(g_state, g_semid, "[Dyrektor] Proces PID %d zakończył się nieoczekiwanie (status %d)",
+                  child.pid, status);
+    }
+    if (child.pidfd != -1) {
+        epoll_ctl(g_epfd, EPOLL_CTL_DEL, child.pidfd, nullptr);
+        close(child.pidfd);
+        child.pidfd = -1;
+    }
+    for (int d = 0; d < DOCTOR_COUNT; d++)
+        for (int inst = 0; inst < DOCTOR_MAX_INSTANCES; inst++)
+            if (g_state->doctor_pids[d][inst] == child.pid) g_state->doctor_pids[d][inst] = 0;
+    if (child.pid == g_generator_pid) {
+        g_generator_pid = -1;
+        if (g_state->draining && !shouldStop()) {
+            printf("Drenaż zakończony — zamykanie symulacji...\n");
+            logMessage(g_state, g_semid, "[Dyrektor] Drenaż zakończony — zamykanie symulacji");
             g_state->shutdown = 1;
             g_shutdown = 1;
-            break;
         }
     }
+    child.pid = 0;
+}
+
+static void handleSignalFd() {
+    struct signalfd_siginfo si;
+    while (read(g_sigfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+        g_shutdown = 1;
+        if (g_state) g_state->shutdown = 1;
+    }
+}
+
+/// Okresowy timerfd (okres w ns ściennych) zarejestrowany w epoll pod tagiem
+static int armPeriodicTimer(long long period_ns, uint64_t tag, const char* what) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd == -1) SOR_FATAL("timerfd_create (%s)", what);
+    struct itimerspec its{};
+    its.it_value.tv_sec = its.it_interval.tv_sec = period_ns / 1000000000LL;
+    its.it_value.tv_nsec = its.it_interval.tv_nsec = period_ns % 1000000000LL;
+    if (timerfd_settime(fd, 0, &its, nullptr) == -1) SOR_FATAL("timerfd_settime (%s)", what);
+    epollAdd(fd, tag);
+    return fd;
 }
 
 // ============================================================================
-// OBSŁUGA SYGNAŁÓW
+// AUTOSKALOWANIE SPECJALISTÓW (autoscale_max_staff)
+// ============================================================================
+
+/// Stan autoskalowania jednej specjalności (czynne instancje = sloty 0..active-1)
+struct SpecialtyScale {
+    int active;
+    int peak;
+    int scale_ups, scale_downs;
+    long long last_change_ns;          // Cool-down liczony od ostatniej zmiany obsady
+    long long idle_since_ns;           // 0 = specjalność nie jest bezczynna
+    long long last_wait_count, last_wait_sum_ns;
+    long long last_busy_ns;
+    long long instance_ns;             // Całka obsady: suma czasu czynnych instancji
+    long long instance_since_ns;       // Od kiedy obecne active nie doliczone do instance_ns
+};
+struct Autoscale {
+    bool enabled;
+    int timerfd;
+    SpecialtyScale spec[DOCTOR_COUNT];
+};
+static Autoscale g_autoscale{};
+
+static long long simMsToWallNs(int ms) {
+    return (long long)(ms * 1e6 / g_time_scale_arg);
+}
+
+/// Dolicza czas obecnej obsady do instance_ns — przed każdą zmianą active i przy raporcie
+static void accrueInstanceTime(SpecialtyScale& s, long long now) {
+    s.instance_ns += s.active * (now - s.instance_since_ns);
+    s.instance_since_ns = now;
+}
+
+/// Uruchamia okresowe próbkowanie kolejek specjalistów (gdy scenariusz włącza autoskalowanie)
+static void armAutoscale() {
+    if (g_scenario.p.autoscale_max_staff <= 0) return;
+    g_autoscale.enabled = true;
+    long long now = monotonicNs();
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        SpecialtyScale& s = g_autoscale.spec[d];
+        s.active = s.peak = g_scenario.p.doctor_staff[d];
+        s.last_change_ns = s.instance_since_ns = now;
+    }
+
+    g_autoscale.timerfd = armPeriodicTimer(simMsToWallNs(AUTOSCALE_TICK_MS), EV_AUTOSCALE, "autoskalowanie");
+
+    logMessage(g_state, g_semid, "[Autoskalowanie] Włączone: obsada specjalistów do %d instancji",
+              g_scenario.p.autoscale_max_staff);
+}
+
+/// Wycofuje instancję: SIGTERM — lekarz kończy bieżącego pacjenta i wychodzi
+static void retireDoctor(int type, int inst) {
+    pid_t pid = g_state->doctor_pids[type][inst];
+    if (pid <= 0) return;
+    for (ChildProc& child : g_children)
+        if (child.pid == pid) child.retired = true;
+    if (kill(pid, SIGTERM) == -1) SOR_WARN("kill SIGTERM do lekarza PID=%d", pid);
+}
+
+/**
+ * @brief Jeden krok autoskalowania: głębokość kolejki i średnie czekanie w okresie
+ *        decydują o dołożeniu instancji; pusta kolejka przy niskiej zajętości przez
+ *        AUTOSCALE_IDLE_MS — o wycofaniu. Cool-down blokuje zmiany jedna po drugiej.
+ */
+static void handleAutoscaleTick() {
+    uint64_t expirations;
+    if (read(g_autoscale.timerfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) return;
+    if (g_state->draining) return;
+
+    long long now = monotonicNs();
+    long long tick_ns = simMsToWallNs(AUTOSCALE_TICK_MS);
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (!g_scenario.p.doctor_enabled[d]) continue;
+        SpecialtyScale& s = g_autoscale.spec[d];
+
+        struct msqid_ds qs{};
+        if (msgctl(g_state->specialist_msgids[d], IPC_STAT, &qs) == -1) continue;
+        int depth = (int)qs.msg_qnum;
+
+        const LatencyStats& w = g_state->specialist_wait[d];
+        long long count = __atomic_load_n(&w.count, __ATOMIC_RELAXED);
+        long long sum_ns = __atomic_load_n(&w.sum_ns, __ATOMIC_RELAXED);
+        double wait_ms = count > s.last_wait_count
+            ? (sum_ns - s.last_wait_sum_ns) * g_time_scale_arg / 1e6 / (count - s.last_wait_count) : 0.0;
+        s.last_wait_count = count;
+        s.last_wait_sum_ns = sum_ns;
+
+        long long busy_ns = 0;
+        for (int inst = 0; inst < DOCTOR_MAX_INSTANCES; inst++)
+            busy_ns += __atomic_load_n(&g_state->doctor_stats[d][inst].busy_ns, __ATOMIC_RELAXED);
+        double util = (double)(busy_ns - s.last_busy_ns) / ((double)s.active * tick_ns);
+        s.last_busy_ns = busy_ns;
+
+        bool cooled = now - s.last_change_ns >= simMsToWallNs(AUTOSCALE_COOLDOWN_MS);
+        bool backlog = depth >= s.active * AUTOSCALE_UP_QUEUE || wait_ms >= AUTOSCALE_UP_WAIT_MS;
+        if (backlog) {
+            s.idle_since_ns = 0;
+            if (!cooled || s.active >= maxDoctorStaff(g_scenario.p, d)) continue;
+            if (spawnDoctor(d, s.active, g_placement.enabled ? &g_placement.generator_set : nullptr) <= 0)
+                continue;
+            accrueInstanceTime(s, now);
+            s.active++;
+            s.scale_ups++;
+            if (s.active > s.peak) s.peak = s.active;
+            s.last_change_ns = now;
+            logMessage(g_state, g_semid, "[Autoskalowanie] %s +1 → %d (kolejka %d, czekanie %.0f ms)",
+                      getDoctorName((DoctorType)d), s.active, depth, wait_ms);
+        } else if (depth == 0 && util < AUTOSCALE_DOWN_UTIL) {
+            if (s.idle_since_ns == 0) s.idle_since_ns = now;
+            if (!cooled || s.active <= g_scenario.p.doctor_staff[d]
+                || now - s.idle_since_ns < simMsToWallNs(AUTOSCALE_IDLE_MS))
+                continue;
+            accrueInstanceTime(s, now);
+            s.active--;
+            retireDoctor(d, s.active);
+            s.scale_downs++;
+            s.last_change_ns = now;
+            s.idle_since_ns = 0;
+            logMessage(g_state, g_semid, "[Autoskalowanie] %s -1 → %d (bezczynność, zajętość %.0f%%)",
+                      getDoctorName((DoctorType)d), s.active, util * 100.0);
+        } else {
+            s.idle_since_ns = 0;
+        }
+    }
+}
+
+// ============================================================================
+// PLAN PRZERW LEKARZY (break_interval_ms)
+// ============================================================================
+
+/// Plan przerw jednej instancji; pending = SIGUSR1 wysłany, lekarz jeszcze nie wyszedł
+struct BreakSlot {
+    long long due_ns;                  // 0 = slot jeszcze nie zaplanowany
+    bool pending;
+    bool deferred;                     // Odroczenie już policzone w tym okresie
+    int breaks_at_request;
+};
+struct BreakPlanner {
+    bool enabled;
+    int timerfd;
+    BreakSlot slot[DOCTOR_COUNT][DOCTOR_MAX_INSTANCES];
+    int granted[DOCTOR_COUNT];
+    int deferred[DOCTOR_COUNT];        // Odroczone z powodu kolejki
+    int red_blocked[DOCTOR_COUNT];     // Wstrzymane: ostatni dostępny lekarz, czerwony w kolejce
+};
+static BreakPlanner g_breaks{};
+
+static void armBreakPlanner() {
+    if (g_scenario.p.break_interval_ms <= 0) return;
+    g_breaks.enabled = true;
+    g_breaks.timerfd = armPeriodicTimer(simMsToWallNs(BREAK_TICK_MS), EV_BREAKS, "plan przerw");
+    logMessage(g_state, g_semid, "[Przerwy] Plan przerw: co %d ms na instancję, odroczenie do %d ms",
+              g_scenario.p.break_interval_ms, g_scenario.p.break_max_defer_ms);
+}
+
+/**
+ * @brief Jeden krok planu przerw: w każdej specjalności najwyżej jedna instancja poza
+ *        obsadą; przerwa nie odbiera ostatniego lekarza, gdy czeka czerwony, i czeka na
+ *        niską kolejkę — chyba że jest spóźniona o break_max_defer_ms.
+ */
+static void handleBreakTick() {
+    uint64_t expirations;
+    if (read(g_breaks.timerfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) return;
+    if (g_state->draining) return;
+
+    long long now = monotonicNs();
+    long long interval_ns = simMsToWallNs(g_scenario.p.break_interval_ms);
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (!g_scenario.p.doctor_enabled[d]) continue;
+        int slots = maxDoctorStaff(g_scenario.p, d);
+
+        int available = 0, away = 0, candidate = -1;
+        for (int inst = 0; inst < slots; inst++) {
+            BreakSlot& b = g_breaks.slot[d][inst];
+            if (g_state->doctor_pids[d][inst] <= 0) {
+                b = BreakSlot{};   // Wycofany/nieuruchomiony slot — nowa instancja zaczyna od nowa
+                continue;
+            }
+            // Rozłożenie pierwszych przerw instancji w okresie
+            if (b.due_ns == 0) b.due_ns = now + interval_ns + interval_ns * inst / slots;
+            if (b.pending && g_state->doctor_stats[d][inst].breaks != b.breaks_at_request) b.pending = false;
+            if (b.pending || g_state->doctor_on_break[d][inst]) {
+                away++;
+                continue;
+            }
+            available++;
+            if (b.due_ns > now) continue;
+            // Najbardziej spóźniona; przy remisie wolna (wyjdzie od razu) przed leczącą
+            if (candidate < 0 || b.due_ns < g_breaks.slot[d][candidate].due_ns
+                || (b.due_ns == g_breaks.slot[d][candidate].due_ns
+                    && g_state->doctor_treating[d][inst] == COLOR_NONE))
+                candidate = inst;
+        }
+        if (candidate < 0 || away > 0) continue;
+
+        BreakSlot& b = g_breaks.slot[d][candidate];
+        int remaining = available - 1;
+        if (remaining == 0 && __atomic_load_n(&g_state->red_queued[d], __ATOMIC_RELAXED) > 0) {
+            g_breaks.red_blocked[d]++;
+            continue;
+        }
+        struct msqid_ds qs{};
+        int depth = msgctl(g_state->specialist_msgids[d], IPC_STAT, &qs) == 0 ? (int)qs.msg_qnum : 0;
+        bool overdue = now - b.due_ns >= simMsToWallNs(g_scenario.p.break_max_defer_ms);
+        if (depth > remaining * BREAK_BACKLOG_PER_DOCTOR && !overdue) {
+            if (!b.deferred) g_breaks.deferred[d]++;
+            b.deferred = true;
+            continue;
+        }
+
+        // Licznik przed sygnałem — wolny lekarz może wyjść, zanim kill wróci
+        pid_t pid = g_state->doctor_pids[d][candidate];
+        b.breaks_at_request = __atomic_load_n(&g_state->doctor_stats[d][candidate].breaks, __ATOMIC_RELAXED);
+        if (kill(pid, SIGUSR1) == -1) {
+            SOR_WARN("kill SIGUSR1 do lekarza PID=%d", pid);
+            continue;
+        }
+        b.pending = true;
+        b.deferred = false;
+        b.due_ns = now + interval_ns;
+        g_breaks.granted[d]++;
+        logMessage(g_state, g_semid, "[Przerwy] Lekarz %s #%d na oddział (kolejka %d, zostaje %d)",
+                  getDoctorName((DoctorType)d), candidate + 1, depth, remaining);
+    }
+}
+
+// ============================================================================
+// ODDZIAŁY SZPITALNE (ward_beds_*)
+// ============================================================================
+
+struct Wards {
+    bool enabled;
+    int timerfd;
+    long long started_ns;              // Początek całki zajętości
+    long long last_ns;                 // Ostatni krok wypisów
+};
+static Wards g_wards{};
+
+/**
+ * @brief Włącza wypisy z oddziałów o skończonej liczbie łóżek. Łóżka zajęte na starcie
+ *        (ward_initial_pct; semafory już pomniejszone w initIPC) dostają pozostały pobyt
+ *        z tego samego rozkładu wykładniczego — bez pamięci, więc średnia się nie zmienia.
+ */
+static void armWards() {
+    bool any = false;
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) any |= wardLimited((DoctorType)d);
+    if (!any) return;
+    g_wards.enabled = true;
+
+    long long now = monotonicNs();
+    {
+        RngScope rng(RNG_ROLE_WARD, 0);
+        semWait(g_semid, SEM_SHM_MUTEX);
+        for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) {
+            int initial = g_scenario.p.ward_beds[d] * g_scenario.p.ward_initial_pct / 100;
+            for (int i = 0; i < initial; i++)
+                wardOccupy(g_state, (DoctorType)d, now + randomWardStayNs((DoctorType)d));
+        }
+        semSignal(g_semid, SEM_SHM_MUTEX);
+    }
+    g_wards.started_ns = g_wards.last_ns = now;
+
+    // Krok w czasie symulacji, ale nie częściej niż co 1 ms ściennie (duże -x)
+    long long tick_ns = simMsToWallNs(WARD_TICK_MS);
+    g_wards.timerfd = armPeriodicTimer(tick_ns > 1000000LL ? tick_ns : 1000000LL, EV_WARDS, "oddziały");
+
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) {
+        if (!wardLimited((DoctorType)d)) continue;
+        logMessage(g_state, g_semid, "[Oddziały] %s: %d łóżek (zajętych %d), średni pobyt %.1f h",
+                  getWardName((DoctorType)d), g_scenario.p.ward_beds[d], g_state->ward_occupied[d],
+                  g_scenario.p.ward_los_ms[d] / 3.6e6);
+    }
+}
+
+/// Krok wypisów: całka zajętości od poprzedniego kroku, zdjęcie minionych terminów z kopca
+static void handleWardTick() {
+    uint64_t expirations;
+    if (read(g_wards.timerfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) return;
+
+    long long now = monotonicNs();
+    int freed[DOCTOR_COUNT] = {0};
+    semWait(g_semid, SEM_SHM_MUTEX);
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++)
+        g_state->ward_bed_ns[d] += (long long)g_state->ward_occupied[d] * (now - g_wards.last_ns);
+    while (g_state->ward_heap_size > 0 && g_state->ward_heap[0].due_ns <= now) {
+        int d = wardHeapPop(g_state).dept;
+        g_state->ward_occupied[d]--;
+        g_state->ward_discharged[d]++;
+        freed[d]++;
+    }
+    semSignal(g_semid, SEM_SHM_MUTEX);
+    g_wards.last_ns = now;
+
+    // Zwolnione łóżka jednym semop na oddział — budzi czekających w SOR
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) {
+        if (freed[d] == 0) continue;
+        struct sembuf op{};
+        op.sem_num = getWardSemIndex((DoctorType)d);
+        op.sem_op = freed[d];
+        if (semop(g_semid, &op, 1) == -1 && errno != EIDRM && errno != EINVAL)
+            SOR_WARN("semop zwolnienie łóżek (%s)", getWardName((DoctorType)d));
+    }
+}
+
 // ============================================================================
+// WYSZUKIWANIE PUNKTU NASYCENIA (-S)
+// ============================================================================
+
+/// Uruchamia okresowy timer kroków (czas symulacji przeliczony na ścienny)
+static void armSweep() {
+    if (!g_sweep.enabled) return;
+
+    long long step_ns = (long long)(g_sweep.step_s * 1e9 / g_time_scale_arg);
+    g_sweep.timerfd = armPeriodicTimer(step_ns, EV_SWEEP, "-S");
+
+    printf("Wyszukiwanie nasycenia: start %.2f/s, krok +%.2f/s co %d s\n",
+           g_sweep.start, g_sweep.step, g_sweep.step_s);
+    logMessage(g_state, g_semid, "[Nasycenie] Start %.2f pacjentów/s, krok +%.2f/s co %d s",
+              g_sweep.start, g_sweep.step, g_sweep.step_s);
+}
+
+/// Koniec kroku: pomiar, detekcja kolana, zwiększenie intensywności albo zakończenie
+static void handleSweepTick() {
+    uint64_t expirations;
+    if (read(g_sweep.timerfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) return;
+
+    semWait(g_semid, SEM_SHM_MUTEX);
+    int in_system = g_state->active_patient_count;
+    int reg_queue = g_state->reg_queue_count;
+    semSignal(g_semid, SEM_SHM_MUTEX);
+
+    long long completed = __atomic_load_n(&g_state->completed_patients, __ATOMIC_RELAXED);
+    long long count = __atomic_load_n(&g_state->sojourn.count, __ATOMIC_RELAXED);
+    long long sum_ns = __atomic_load_n(&g_state->sojourn.sum_ns, __ATOMIC_RELAXED);
+    long long max_ns = __atomic_exchange_n(&g_state->sojourn.max_ns, 0, __ATOMIC_RELAXED);  // Maks. per krok
+
+    SweepStep st{};
+    st.offered = g_state->gen_rate;
+    st.throughput = (double)(completed - g_sweep.last_completed) / g_sweep.step_s;
+    long long dn = count - g_sweep.last_count;
+    st.sojourn_avg_s = dn ? (sum_ns - g_sweep.last_sum_ns) * g_time_scale_arg / 1e9 / dn : 0.0;
+    st.sojourn_max_s = max_ns * g_time_scale_arg / 1e9;
+    for (int s = 0; s < HANDOFF_COUNT; s++) {
+        long long sc = __atomic_load_n(&g_state->stage_time[s].count, __ATOMIC_RELAXED);
+        long long ss = __atomic_load_n(&g_state->stage_time[s].sum_ns, __ATOMIC_RELAXED);
+        long long ds = sc - g_sweep.last_stage_count[s];
+        st.stage_avg_s[s] = ds ? (ss - g_sweep.last_stage_sum_ns[s]) * g_time_scale_arg / 1e9 / ds : 0.0;
+        g_sweep.last_stage_count[s] = sc;
+        g_sweep.last_stage_sum_ns[s] = ss;
+    }
+    st.in_system = in_system;
+    st.reg_queue = reg_queue;
+    g_sweep.steps.push_back(st);
+
+    printf("[Nasycenie] napływ %6.2f/s → wyjścia %6.2f/s, pobyt śr. %6.1f s (maks. %6.1f s; rej. %.1f, "
+           "triaż %.1f, spec. %.1f), w systemie %d, kolejka rej. %d\n",
+           st.offered, st.throughput, st.sojourn_avg_s, st.sojourn_max_s, st.stage_avg_s[HANDOFF_REGISTRATION],
+           st.stage_avg_s[HANDOFF_TRIAGE], st.stage_avg_s[HANDOFF_SPECIALIST], in_system, reg_queue);
+    logMessage(g_state, g_semid, "[Nasycenie] napływ %.2f/s, wyjścia %.2f/s, pobyt śr. %.1f s, w systemie %d",
+              st.offered, st.throughput, st.sojourn_avg_s, in_system);
+
+    // Kolano: przepustowość nie nadąża za napływem, a pacjentów w systemie przybywa
+    bool tracking = st.throughput >= SWEEP_TRACK_RATIO * st.offered || in_system <= g_sweep.last_in_system;
+    g_sweep.saturated_steps = tracking ? 0 : g_sweep.saturated_steps + 1;
+
+    g_sweep.last_completed = completed;
+    g_sweep.last_count = count;
+    g_sweep.last_sum_ns = sum_ns;
+    g_sweep.last_in_system = in_system;
+
+    if (g_sweep.saturated_steps >= SWEEP_KNEE_STEPS) {
+        // Ostatnia intensywność przed pierwszym krokiem bez nadążania
+        g_sweep.saturated = true;
+        g_sweep.saturation_rate = st.offered - SWEEP_KNEE_STEPS * g_sweep.step;
+        if (g_sweep.saturation_rate < g_sweep.start) {
+            printf("\nNasycenie poniżej startowej intensywności %.2f pacjentów/s — zamykanie...\n",
+                   g_sweep.start);
+            logMessage(g_state, g_semid, "[Nasycenie] Kolano poniżej startu %.2f/s — zamykanie symulacji",
+                      g_sweep.start);
+        } else {
+            printf("\nPunkt nasycenia: ~%.2f pacjentów/s — zamykanie...\n", g_sweep.saturation_rate);
+            logMessage(g_state, g_semid, "[Nasycenie] Kolano przy %.2f/s — zamykanie symulacji",
+                      g_sweep.saturation_rate);
+        }
+        g_state->shutdown = 1;
+        g_shutdown = 1;
+        return;
+    }
+
+    g_state->gen_rate = st.offered + g_sweep.step;
+}
 
-static void signalHandler(int /*sig*/) {
+/// Obciążenie instancji lekarzy — przy obsadzie > 1 sprawdza, czy praca rozkłada się równo
+static void printStaffReport() {
+    double elapsed_ns = (double)(monotonicNs() - ((long long)g_state->start_time_sec * 1000000000LL
+                                                  + g_state->start_time_nsec));
+    printf("\n--- Obsada lekarzy ---\n");
+    for (int d = DOCTOR_POZ; d < DOCTOR_COUNT; d++) {
+        if (!g_scenario.p.doctor_enabled[d]) continue;
+        int slots = maxDoctorStaff(g_scenario.p, d);
+        long long total = 0;
+        for (int inst = 0; inst < slots; inst++)
+            total += g_state->doctor_stats[d][inst].served;
+        if (total == 0) continue;
+        printf("  %-11s obsada=%d  pacjentów=%lld", getDoctorName((DoctorType)d),
+               g_scenario.p.doctor_staff[d], total);
+        if (g_autoscale.enabled && d != DOCTOR_POZ) {
+            const SpecialtyScale& s = g_autoscale.spec[d];
+            printf("  autoskalowanie: +%d/-%d, szczyt %d", s.scale_ups, s.scale_downs, s.peak);
+        }
+        printf("\n");
+        for (int inst = 0; inst < slots; inst++) {
+            const DoctorStats& ds = g_state->doctor_stats[d][inst];
+            if (inst >= g_scenario.p.doctor_staff[d] && ds.served == 0) continue;
+            printf("    #%d: pacjentów=%-6lld zajętość=%5.1f%%  przerwy=%d", inst + 1, ds.served,
+                   elapsed_ns > 0 ? 100.0 * ds.busy_ns / elapsed_ns : 0.0, ds.breaks);
+            if (ds.preemptions > 0) printf("  wywłaszczenia=%d", ds.preemptions);
+            if (ds.stolen > 0) printf("  przejęci=%lld", ds.stolen);
+            printf("\n");
+        }
+    }
+
+    // Czekanie w kolejce specjalisty wg koloru — porównanie obsady i trybów kolejności
+    printf("  Czekanie na specjalistę (czas symulacji, kolejność: %s):\n",
+           g_scenario.p.specialist_sched == SCHED_EDF ? "EDF" : "ścisły priorytet");
+    for (int c = COLOR_RED; c <= COLOR_GREEN; c++) {
+        const LatencyStats& w = g_state->color_wait[c];
+        if (w.count == 0) continue;
+        printf("    %-9s pacjentów=%-6lld śr.=%9.1f ms  maks.=%9.1f ms  po terminie %d ms: %5.1f%%\n",
+               getColorName((TriageColor)c), w.count, w.sum_ns * g_time_scale_arg / 1e6 / w.count,
+               w.max_ns * g_time_scale_arg / 1e6, g_scenario.p.deadline_ms[c],
+               100.0 * g_state->deadline_miss[c] / w.count);
+    }
+}
+
+/**
+ * @brief Przerwy: utracona zdolność obsługi i czekanie na specjalistę z pełną obsadą i bez
+ *
+ * Utracona zdolność = czas na oddziale / czas czynnych instancji — przy autoskalowaniu
+ * całka obsady z g_autoscale, bez niego czas trwania × doctor_staff.
+ */
+static void printBreakReport() {
+    long long now = monotonicNs();
+    double elapsed_ns = (double)(now - ((long long)g_state->start_time_sec * 1000000000LL
+                                        + g_state->start_time_nsec));
+    bool any = false;
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (!g_scenario.p.doctor_enabled[d]) continue;
+        long long break_ns = 0;
+        int breaks = 0;
+        for (int inst = 0; inst < DOCTOR_MAX_INSTANCES; inst++) {
+            break_ns += g_state->doctor_stats[d][inst].break_ns;
+            breaks += g_state->doctor_stats[d][inst].breaks;
+        }
+        if (breaks == 0 && g_breaks.red_blocked[d] == 0 && g_breaks.deferred[d] == 0) continue;
+        double instance_ns = elapsed_ns * g_scenario.p.doctor_staff[d];
+        if (g_autoscale.enabled) {
+            accrueInstanceTime(g_autoscale.spec[d], now);
+            instance_ns = (double)g_autoscale.spec[d].instance_ns;
+        }
+        if (!any) printf("\n--- Przerwy lekarzy ---\n");
+        any = true;
+        printf("  %-11s przerwy=%-3d utracona zdolność=%5.1f%% obsady", getDoctorName((DoctorType)d), breaks,
+               instance_ns > 0 ? 100.0 * break_ns / instance_ns : 0.0);
+        if (g_breaks.enabled)
+            printf("  odroczone=%d  wstrzymane (czerwony)=%d", g_breaks.deferred[d], g_breaks.red_blocked[d]);
+        printf("\n");
+    }
+    if (!any) return;
+    const char* const labels[] = { "pełna obsada", "ktoś na przerwie" };
+    for (int i = 0; i < 2; i++) {
+        const LatencyStats& w = g_state->break_wait[i];
+        if (w.count == 0) continue;
+        printf("  Czekanie na specjalistę, %-16s pacjentów=%-6lld śr.=%9.1f ms  maks.=%9.1f ms\n", labels[i],
+               w.count, w.sum_ns * g_time_scale_arg / 1e6 / w.count, w.max_ns * g_time_scale_arg / 1e6);
+    }
+}
+
+/// Czekanie generatora na przyjęcie (limit -p / wiadro -b)
+static void printAdmissionReport() {
+    if (g_max_patients <= 0 && g_admit_rate <= 0.0) return;
+    const LatencyStats& w = g_state->admission_wait;
+    double avg_ms = w.count ? w.sum_ns * g_time_scale_arg / 1e6 / w.count : 0.0;
+    printf("\n--- Kontrola przyjęć ---\n");
+    printf("  Przyjęcia=%lld  czekanie śr.=%.1f ms  maks.=%.1f ms (czas symulacji)\n",
+           w.count, avg_ms, w.max_ns * g_time_scale_arg / 1e6);
+}
+
+/// Polityka przeciążenia: odesłani z triażu wg kolejki albo wstrzymania przyjęć
+static void printOverloadReport() {
+    int policy = g_scenario.p.overload_policy;
+    if (policy == OVERLOAD_NONE) return;
+    static const char* const POLICY_NAMES[] = { "brak", "inna placówka", "do domu", "wstrzymanie przyjęć" };
+    printf("\n--- Przeciążenie (limit kolejki %d, polityka: %s) ---\n",
+           g_scenario.p.backlog_limit, POLICY_NAMES[policy]);
+    if (policy == OVERLOAD_BACKPRESSURE) {
+        const LatencyStats& w = g_state->backpressure_wait;
+        printf("  Wstrzymania=%lld  śr.=%.1f ms  maks.=%.1f ms (czas symulacji)\n", w.count,
+               w.count ? w.sum_ns * g_time_scale_arg / 1e6 / w.count : 0.0, w.max_ns * g_time_scale_arg / 1e6);
+        return;
+    }
+    long long total = 0;
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (g_state->shed[d] == 0) continue;
+        printf("  %-11s odesłanych=%lld\n", getDoctorName((DoctorType)d), g_state->shed[d]);
+        total += g_state->shed[d];
+    }
+    printf("  Razem odesłanych=%lld\n", total);
+}
+
+/// Triaż NEWS2 partiami: wielkość partii, koszt punktacji, rozkład kolorów
+static void printTriageReport() {
+    if (g_scenario.p.triage_mode != TRIAGE_NEWS) return;
+    long long batches = g_state->triage_batches, patients = g_state->triage_batched;
+    printf("\n--- Triaż NEWS2 (partie do %d pacjentów) ---\n", TRIAGE_BATCH_MAX);
+    printf("  Partie=%lld  pacjenci=%lld  śr. partia=%.2f\n", batches, patients,
+           batches ? (double)patients / batches : 0.0);
+    printf("  Punktacja: %.0f ns/partię, %.0f ns/pacjenta (czas rzeczywisty)\n",
+           batches ? (double)g_state->triage_score_ns / batches : 0.0,
+           patients ? (double)g_state->triage_score_ns / patients : 0.0);
+    printf("  Kolory:");
+    for (int c = COLOR_RED; c <= COLOR_SENT_HOME; c++)
+        printf(" %s=%lld", getColorName((TriageColor)c), g_state->triage_news_color[c]);
+    printf("\n");
+}
+
+/// Oddziały: średnia zajętość łóżek i czekanie w SOR na łóżko (boarding, czas symulacji)
+static void printWardReport() {
+    if (!g_wards.enabled) return;
+    double span_ns = (double)(g_wards.last_ns - g_wards.started_ns);
+    printf("\n--- Oddziały szpitalne ---\n");
+    printf("  %-13s %6s %8s %8s %9s %6s %12s %12s %9s\n", "oddział", "łóżka", "przyjęci", "wypisani",
+           "zajętość", "maks.", "czekanie śr.", "czekanie max", "w SOR max");
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_PEDIATRA; d++) {
+        if (!wardLimited((DoctorType)d)) continue;
+        int beds = g_scenario.p.ward_beds[d];
+        const LatencyStats& w = g_state->ward_boarding_wait[d];
+        printf("  %-13s %6d %8lld %8lld %8.1f%% %6d %10.1f s %10.1f s %9d\n",
+               getWardName((DoctorType)d), beds, g_state->ward_admitted[d], g_state->ward_discharged[d],
+               span_ns > 0 ? 100.0 * g_state->ward_bed_ns[d] / (span_ns * beds) : 0.0, g_state->ward_peak[d],
+               w.count ? w.sum_ns * g_time_scale_arg / 1e9 / w.count : 0.0, w.max_ns * g_time_scale_arg / 1e9,
+               g_state->ward_boarding_peak[d]);
+    }
+}
+
+/// Krzywa przepustowość–czas pobytu: tabela na stdout + CSV
+static void printSaturationReport() {
+    if (!g_sweep.enabled) return;
+
+    printf("\n--- Krzywa nasycenia (krok %d s) ---\n", g_sweep.step_s);
+    // Etapy (średnie w kroku): wejście → rejestracja → triaż → specjalista, z czekaniem w kolejkach
+    printf("  %8s %8s %10s %10s %9s %9s %9s %8s\n", "napływ/s", "wyjścia/s", "pobyt śr.", "pobyt max",
+           "rej. śr.", "triaż śr.", "spec. śr.", "w syst.");
+    FILE* csv = fopen(SWEEP_CSV, "w");
+    if (csv) fprintf(csv, "offered_per_s,throughput_per_s,sojourn_avg_s,sojourn_max_s,"
+                          "registration_avg_s,triage_avg_s,specialist_avg_s,in_system,reg_queue\n");
+    for (const SweepStep& st : g_sweep.steps) {
+        const double* sa = st.stage_avg_s;
+        printf("  %8.2f %8.2f %9.1fs %9.1fs %8.1fs %8.1fs %8.1fs %8d\n",
+               st.offered, st.throughput, st.sojourn_avg_s, st.sojourn_max_s, sa[HANDOFF_REGISTRATION],
+               sa[HANDOFF_TRIAGE], sa[HANDOFF_SPECIALIST], st.in_system);
+        if (csv) fprintf(csv, "%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d\n", st.offered, st.throughput,
+                         st.sojourn_avg_s, st.sojourn_max_s, sa[HANDOFF_REGISTRATION], sa[HANDOFF_TRIAGE],
+                         sa[HANDOFF_SPECIALIST], st.in_system, st.reg_queue);
+    }
+    if (csv) fclose(csv);
+    else SOR_WARN("fopen %s", SWEEP_CSV);
+
+    if (g_sweep.saturated && g_sweep.saturation_rate < g_sweep.start)
+        printf("  Nasycenie poniżej startowej intensywności %.2f pacjentów/s (krzywa: %s)\n",
+               g_sweep.start, SWEEP_CSV);
+    else if (g_sweep.saturated)
+        printf("  Punkt nasycenia: ~%.2f pacjentów/s (krzywa: %s)\n", g_sweep.saturation_rate, SWEEP_CSV);
+    else
+        printf("  Nie osiągnięto nasycenia do %.2f pacjentów/s (krzywa: %s)\n",
+               g_sweep.steps.empty() ? g_sweep.start : g_sweep.steps.back().offered, SWEEP_CSV);
+}
+
+static void handleTimer() {
+    uint64_t expirations;
+    if (read(g_timerfd, &expirations, sizeof(expirations)) != (ssize_t)sizeof(expirations)) return;
+
+    if (g_drain_on_timeout) {
+        printf("\nCzas symulacji (%d s) upłynął — drenaż...\n", g_max_time);
+        startDrain();
+        return;
+    }
+
+    printf("\nCzas symulacji (%d s) upłynął — zamykanie...\n", g_max_time);
+    logMessage(g_state, g_semid, "[Dyrektor] Timeout %d s — zamykanie symulacji", g_max_time);
+    g_state->shutdown = 1;
     g_shutdown = 1;
-    if (g_state) g_state->shutdown = 1;
 }
 
-/// Automatycznie reapuje martwe procesy potomne (zapobiega zombie).
-static void sigchldHandler(int /*sig*/) {
-    while (waitpid(-1, nullptr, WNOHANG) > 0) {}
+static void handleStdin() {
+    char c;
+    ssize_t r = read(STDIN_FILENO, &c, 1);
+    if (r == 1) {
+        handleKey(c);
+    } else if (r == 0 || (errno != EINTR && errno != EAGAIN)) {
+        unwatchStdin();   // EOF — dalej działa tylko timer/sygnały
+    }
 }
 
-static void setupSignals() {
-    struct sigaction sa{};
-    sa.sa_handler = signalHandler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
+/// timerfd zarejestrowany pod tagiem epoll (-1 gdy tag nie jest timerem)
+static int timerFdForTag(uint64_t tag) {
+    switch (tag) {
+        case EV_TIMER:     return g_timerfd;
+        case EV_SWEEP:     return g_sweep.timerfd;
+        case EV_AUTOSCALE: return g_autoscale.timerfd;
+        case EV_BREAKS:    return g_breaks.timerfd;
+        case EV_WARDS:     return g_wards.timerfd;
+        default:           return -1;
+    }
+}
 
-    sigaction(SIGINT, &sa, nullptr);
-    sigaction(SIGTERM, &sa, nullptr);
-    sigaction(SIGHUP, &sa, nullptr);
+/// Obsługuje jedno zdarzenie z epoll. Zdarzenia stdin/timer ignorowane gdy ignore_input.
+static void dispatchEvent(const struct epoll_event& ev, bool ignore_input) {
+    uint64_t tag = ev.data.u64;
+    if (tag >= EV_CHILD_BASE) {
+        reapChild(tag - EV_CHILD_BASE);
+    } else if (tag == EV_SIGNAL) {
+        handleSignalFd();
+    } else if (ignore_input) {
+        // Nieodczytany timerfd zostaje gotowy (level-triggered) i kręciłby pętlą zamykania
+        if (tag == EV_STDIN) unwatchStdin();
+        else if (timerFdForTag(tag) != -1) epoll_ctl(g_epfd, EPOLL_CTL_DEL, timerFdForTag(tag), nullptr);
+    } else if (tag == EV_TIMER) {
+        handleTimer();
+    } else if (tag == EV_SWEEP) {
+        handleSweepTick();
+    } else if (tag == EV_AUTOSCALE) {
+        handleAutoscaleTick();
+    } else if (tag == EV_BREAKS) {
+        handleBreakTick();
+    } else if (tag == EV_WARDS) {
+        handleWardTick();
+    } else if (tag == EV_STDIN) {
+        handleStdin();
+    }
+}
 
-    struct sigaction sa_chld{};
-    sa_chld.sa_handler = sigchldHandler;
-    sigemptyset(&sa_chld.sa_mask);
-    sa_chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa_chld, nullptr);
+static void runEventLoop() {
+    printf("\nCzekam na komendy (1-6: lekarz na oddział, 7: ewakuacja, d: drenaż, q: wyjście)...\n\n");
+    fflush(stdout);
 
+    while (!shouldStop()) {
+        struct epoll_event events[16];
+        int n = epoll_wait(g_epfd, events, 16, -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            SOR_WARN("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++)
+            dispatchEvent(events[i], false);
+    }
+}
+
+// ============================================================================
+// OBSŁUGA SYGNAŁÓW
+// ============================================================================
+
+static void setupSignals() {
+    // SIGINT/SIGTERM/SIGHUP → signalfd (initEventLoop), SIGCHLD → pidfd (registerChild)
     atexit(cleanupIPC);
 }
 
@@ -336,40 +1447,126 @@ static void setupSignals() {
 // ZAMKNIĘCIE PROCESÓW
 // ============================================================================
 
-/// Czeka na generator (do 5s), potem SIGKILL. Zeruje jego slot w g_child_pids.
+static bool childAlive(pid_t pid) {
+    for (const ChildProc& child : g_children)
+        if (child.pid == pid && pid > 0) return true;
+    return false;
+}
+
+static bool anyChildAlive() {
+    for (const ChildProc& child : g_children)
+        if (child.pid > 0) return true;
+    return false;
+}
+
+/// Czeka w epoll aż warunek done() będzie spełniony albo minie timeout_ms (zegar ścienny)
+template <typename Pred>
+static bool waitChildrenUntil(Pred done, int timeout_ms) {
+    long long deadline = monotonicMs() + timeout_ms;
+    while (!done()) {
+        long long left = deadline - monotonicMs();
+        if (left <= 0) return false;
+
+        struct epoll_event events[16];
+        int n = epoll_wait(g_epfd, events, 16, (int)left);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            SOR_WARN("epoll_wait (zamykanie)");
+            return done();
+        }
+        for (int i = 0; i < n; i++)
+            dispatchEvent(events[i], true);
+    }
+    return true;
+}
+
+/// Ostateczność: SIGKILL + blokujący waitpid
+static void killChild(ChildProc& child) {
+    if (child.pid <= 0) return;
+    kill(child.pid, SIGKILL);
+    waitpid(child.pid, nullptr, 0);
+    if (child.pidfd != -1) { close(child.pidfd); child.pidfd = -1; }
+    child.pid = 0;
+}
+
+/// SIGTERM do generatora i czekanie na jego pidfd (do 5s), potem SIGKILL.
 static void shutdownGenerator() {
     if (g_generator_pid <= 0) return;
+    pid_t gen = g_generator_pid;
 
-    kill(g_generator_pid, SIGTERM);
+    kill(gen, SIGTERM);
 
-    bool exited = false;
-    for (int attempt = 0; attempt < 50 && !exited; attempt++) {
-        if (waitpid(g_generator_pid, nullptr, WNOHANG) > 0)
-            exited = true;
-        else
-            usleep(100000);  // 100ms
-    }
-    if (!exited) {
-        kill(g_generator_pid, SIGKILL);
-        waitpid(g_generator_pid, nullptr, 0);
+    if (!waitChildrenUntil([gen] { return !childAlive(gen); }, 5000)) {
+        for (ChildProc& child : g_children)
+            if (child.pid == gen) killChild(child);
     }
-
-    for (auto& pid : g_child_pids)
-        if (pid == g_generator_pid) { pid = 0; break; }
+    g_generator_pid = -1;
 }
 
-/// SIGTERM → 500ms grace → SIGKILL + waitpid dla pozostałych procesów
+/// SIGTERM → czekanie na pidfd wszystkich (do 500ms) → SIGKILL tylko dla maruderów
 static void shutdownRemaining() {
-    for (pid_t pid : g_child_pids)
-        if (pid > 0) kill(pid, SIGTERM);
+    for (const ChildProc& child : g_children)
+        if (child.pid > 0) kill(child.pid, SIGTERM);
 
-    usleep(500000);
+    if (!waitChildrenUntil([] { return !anyChildAlive(); }, 500)) {
+        for (ChildProc& child : g_children)
+            killChild(child);
+    }
+}
 
-    for (pid_t pid : g_child_pids) {
-        if (pid > 0) {
-            kill(pid, SIGKILL);
-            waitpid(pid, nullptr, 0);
-        }
+// ============================================================================
+// RAPORT KOŃCOWY
+// ============================================================================
+
+/// Opóźnienia przekazania odpowiedzi — do porównania przebiegów z -a i bez
+static void printHandoffReport() {
+    const char* plan = g_placement.enabled ? g_placement_arg : "brak (procesy swobodne)";
+    printf("\n--- Opóźnienie przekazania odpowiedzi [rozmieszczenie CPU: %s] ---\n", plan);
+    logMessage(g_state, g_semid, "[Raport] Opóźnienie przekazania, rozmieszczenie CPU: %s", plan);
+
+    for (int i = 0; i < HANDOFF_COUNT; i++) {
+        const LatencyStats& st = g_state->handoff[i];
+        double avg_us = st.count ? st.sum_ns / 1000.0 / st.count : 0.0;
+        printf("  %-22s n=%-6lld śr=%9.1f us  max=%9.1f us\n",
+               getHandoffName((HandoffStage)i), st.count, avg_us, st.max_ns / 1000.0);
+        logMessage(g_state, g_semid, "[Raport]   %s: n=%lld śr=%.1f us max=%.1f us",
+                  getHandoffName((HandoffStage)i), st.count, avg_us, st.max_ns / 1000.0);
+    }
+    static const char* const site_names[] = { "bramka", "kolejka wejścia", "wyjście", "rejestracja", "POZ",
+                                              "specjalista" };
+    static_assert(sizeof(site_names) / sizeof(site_names[0]) == WAIT_SITE_COUNT, "site_names");
+    printf("  Spin-then-block (%s):\n", SPIN_WAIT_ENABLED ? "włączony" : "wyłączony");
+    for (int i = 0; i < WAIT_SITE_COUNT; i++) {
+        const SpinTuner& t = g_state->spin[i];
+        printf("    %-16s spin=%-6lld blok=%-6lld śr. czekania=%9.1f us\n",
+               site_names[i], t.spin_hits, t.blocks, t.ewma_wait_ns / 1000.0);
+    }
+}
+
+/// Zajętość okienek rejestracji — rejestracja domyka okresy otwarcia przed wyjściem
+static void printRegistrationReport() {
+    printf("\n--- Okienka rejestracji (M=%d, sterowanie: %s) ---\n", g_scenario.p.reg_windows,
+           REG_CTRL_MODE == REG_CTRL_PREDICTIVE ? "predykcyjne" : "progowe");
+    int transitions = 0;
+    for (int i = 0; i < g_scenario.p.reg_windows; i++) {
+        const RegWindowStats& ws = g_state->reg_window[i];
+        double util = ws.open_ns > 0 ? 100.0 * ws.busy_ns / ws.open_ns : 0.0;
+        printf("  Okienko %d: obsłużono=%-6lld otwarć=%-4d otwarte=%8.2f s  zajętość=%5.1f%%\n",
+               i + 1, ws.served, ws.open_events, ws.open_ns / 1e9, util);
+        if (i > 0) transitions += ws.open_events;
+    }
+    printf("  Otwarcia okienek 2..M: %d\n", transitions);
+    // Każdy pacjent zmienia kolejkę dwa razy (dołączenie + podejście do okienka)
+    printf("  Przebudzenia kontrolera: %lld przy %lld zmianach kolejki\n",
+           g_state->reg_ctrl_wakeups, 2 * g_state->reg_arrivals);
+
+    if (g_scenario.p.registry_enabled) {
+        const RegistryStats& rs = g_state->registry;
+        double hit_pct = rs.lookup.count ? 100.0 * rs.hits / rs.lookup.count : 0.0;
+        double avg_ns = rs.lookup.count ? (double)rs.lookup.sum_ns / rs.lookup.count : 0.0;
+        printf("  Rejestr pacjentów (%s): rekordów=%lld  trafienia=%lld/%lld (%.1f%%)  "
+               "wyszukiwanie śr=%.0f ns max=%lld ns\n",
+               REGISTRY_FILE, rs.records, rs.hits, rs.lookup.count, hit_pct, avg_ns, rs.lookup.max_ns);
     }
 }
 
@@ -379,7 +1576,7 @@ static void shutdownRemaining() {
 
 int main(int argc, char* argv[]) {
     int opt;
-    while ((opt = getopt(argc, argv, "t:p:g:")) != -1) {
+    while ((opt = getopt(argc, argv, "t:dp:g:x:a:T:R:S:b:s:c:")) != -1) {
         switch (opt) {
             case 't':
                 g_max_time = atoi(optarg);
@@ -388,14 +1585,20 @@ int main(int argc, char* argv[]) {
                     printUsage(argv[0]);
                 }
                 break;
+            case 'd':
+                g_drain_on_timeout = true;
+                break;
             case 'p':
                 g_max_patients = atoi(optarg);
-                if (g_max_patients <= FIXED_PROCESS_COUNT) {
-                    fprintf(stderr, "Błąd: limit procesów musi być > %d (stałe: dyrektor+generator+rejestracja+%d lekarzy)\n",
-                            FIXED_PROCESS_COUNT, ENABLED_DOCTOR_COUNT);
+                if (g_max_patients <= 0) {
+                    fprintf(stderr, "Błąd: limit procesów musi być liczbą > 0 (podano: '%s')\n", optarg);
                     printUsage(argv[0]);
                 }
                 break;
+            case 'c':
+                g_scenario_path = optarg;
+                if (!loadScenario(optarg, g_scenario)) printUsage(argv[0]);
+                break;
             case 'g':
                 g_gen_min_ms = atoi(optarg);
                 if (optind >= argc || argv[optind][0] == '-') {
@@ -409,43 +1612,139 @@ int main(int argc, char* argv[]) {
                     printUsage(argv[0]);
                 }
                 break;
+            case 'T':
+            case 'R':
+                if (access(optarg, R_OK) == -1) {
+                    fprintf(stderr, "Błąd: nie można odczytać pliku '%s' (-%c)\n", optarg, opt);
+                    printUsage(argv[0]);
+                }
+                (opt == 'T' ? g_trace_path : g_profile_path) = optarg;
+                break;
+            case 'b':
+                g_admit_burst = 1;
+                if (sscanf(optarg, "%lf:%d", &g_admit_rate, &g_admit_burst) < 1
+                    || g_admit_rate <= 0.0 || g_admit_burst < 1) {
+                    fprintf(stderr, "Błąd: -b wymaga tempo[:wiadro] > 0 (podano: '%s')\n", optarg);
+                    printUsage(argv[0]);
+                }
+                break;
+            case 'S':
+                g_sweep.step_s = 30;
+                if (sscanf(optarg, "%lf:%lf:%d", &g_sweep.start, &g_sweep.step, &g_sweep.step_s) < 2
+                    || g_sweep.start <= 0.0 || g_sweep.step <= 0.0 || g_sweep.step_s <= 0) {
+                    fprintf(stderr, "Błąd: -S wymaga start:krok[:sekundy] > 0 (podano: '%s')\n", optarg);
+                    printUsage(argv[0]);
+                }
+                g_sweep.enabled = true;
+                break;
+            case 'a':
+                g_placement_arg = optarg;
+                break;
+            case 's': {
+                char* end = nullptr;
+                g_seed_arg = strtoull(optarg, &end, 0);
+                if (end == optarg || *end != '\0' || g_seed_arg == 0) {
+                    fprintf(stderr, "Błąd: -s wymaga liczby całkowitej > 0 (podano: '%s')\n", optarg);
+                    printUsage(argv[0]);
+                }
+                break;
+            }
+            case 'x': {
+                char* end = nullptr;
+                g_time_scale_arg = strtod(optarg, &end);
+                if (end == optarg || *end != '\0' || g_time_scale_arg < 0.01 || g_time_scale_arg > 1000.0) {
+                    fprintf(stderr, "Błąd: -x musi być liczbą z zakresu 0.01-1000 (podano: '%s')\n", optarg);
+                    printUsage(argv[0]);
+                }
+                break;
+            }
             default:
                 printUsage(argv[0]);
         }
     }
 
+    // Liczba stałych procesów zależy od lekarzy włączonych w scenariuszu (-c)
+    if (g_max_patients > 0 && g_max_patients <= fixedProcessCount(g_scenario.p)) {
+        fprintf(stderr, "Błąd: limit procesów musi być > %d (stałe: dyrektor+generator+rejestracja+%d lekarzy)\n",
+                fixedProcessCount(g_scenario.p), doctorProcessCount(g_scenario.p));
+        printUsage(argv[0]);
+    }
+
+    if ((g_trace_path != nullptr) + (g_profile_path != nullptr) + g_sweep.enabled > 1) {
+        fprintf(stderr, "Błąd: -T, -R i -S wykluczają się (jedno źródło napływu)\n");
+        printUsage(argv[0]);
+    }
+
+    planPlacement(argv[0]);
+
+    // Bez -s losujemy ziarno, ale i tak je wypisujemy — przebieg da się powtórzyć
+    if (g_seed_arg == 0) {
+        std::random_device rd;
+        while (g_seed_arg == 0) g_seed_arg = (unsigned long long)rd() << 32 | rd();
+    }
+
     printf("=== SYMULATOR SOR ===\n");
     printf("Sterowanie:\n");
     printf("  1-6: Wyślij lekarza na oddział (1=kardiolog, 2=neurolog, 3=okulista,\n");
     printf("       4=laryngolog, 5=chirurg, 6=pediatra)\n");
     printf("  7:   Ewakuacja - zakończ symulację (SIGUSR2)\n");
+    printf("  d:   Drenaż - koniec przyjęć, pacjenci w SOR kończą wizytę, potem wyjście\n");
     printf("  q:   Wyjście\n");
-    if (g_max_time > 0)     printf("  Limit czasu: %d s\n", g_max_time);
+    if (g_max_time > 0)     printf("  Limit czasu: %d s%s\n", g_max_time,
+                                   g_drain_on_timeout ? " (potem drenaż)" : "");
     if (g_max_patients > 0) printf("  Limit procesów: %d (w tym %d pacjentów)\n",
-                                   g_max_patients, g_max_patients - FIXED_PROCESS_COUNT);
-    if (g_gen_min_ms > 0)   printf("  Generowanie pacjentów: %d-%d ms\n", g_gen_min_ms, g_gen_max_ms);
+                                   g_max_patients, g_max_patients - fixedProcessCount(g_scenario.p));
+    if (g_admit_rate > 0.0) printf("  Limit przyjęć: %.2f pacjentów/s, wiadro %d\n", g_admit_rate, g_admit_burst);
+    if (g_trace_path)        printf("  Ślad przyjęć: %s\n", g_trace_path);
+    else if (g_profile_path) printf("  Profil napływu: %s\n", g_profile_path);
+    else if (g_sweep.enabled)  printf("  Szukanie nasycenia: od %.2f/s, +%.2f/s co %d s\n",
+                                      g_sweep.start, g_sweep.step, g_sweep.step_s);
+    else if (g_gen_min_ms > 0) printf("  Generowanie pacjentów: %d-%d ms\n", g_gen_min_ms, g_gen_max_ms);
+    if (g_time_scale_arg != 1.0) printf("  Przyspieszenie czasu: x%.2f\n", g_time_scale_arg);
+    if (g_scenario_path) printf("  Scenariusz: %s (N=%d, M=%d, lekarzy: %d)\n", g_scenario_path,
+                                g_scenario.p.waiting_capacity, g_scenario.p.reg_windows,
+                                doctorProcessCount(g_scenario.p));
+    printf("  Ziarno losowania: %llu (powtórka: -s %llu)\n", g_seed_arg, g_seed_arg);
+    if (g_placement.enabled) printf("  Rozmieszczenie CPU: %s (generator+pacjenci: %s)\n",
+                                    g_placement_arg, cpuSetToString(&g_placement.generator_set).c_str());
     printf("=====================\n\n");
 
     setupSignals();
+    initEventLoop();
     initIPC();
 
     struct timespec start;
     clock_gettime(CLOCK_MONOTONIC, &start);
     g_state->start_time_sec = start.tv_sec;
     g_state->start_time_nsec = start.tv_nsec;
+    g_state->time_scale = g_time_scale_arg;
+    g_state->run_seed = g_seed_arg;
+    g_state->scenario = g_scenario;
+    initSimClock(g_state);
+    initRandom(g_state);
     g_state->director_pid = getpid();
     g_state->max_patients = g_max_patients;
+    if (g_sweep.enabled) g_state->gen_rate = g_sweep.start;
+    g_state->admit_rate = g_admit_rate;
+    g_state->admit_burst = g_admit_burst;
 
     snprintf(g_state->log_file, sizeof(g_state->log_file), "sor_log.txt");
     FILE* f = fopen(g_state->log_file, "w");
-    if (f) { fprintf(f, "=== LOG SYMULACJI SOR ===\n"); fclose(f); }
+    if (f) { fprintf(f, "=== LOG SYMULACJI SOR === (ziarno %llu)\n", g_seed_arg); fclose(f); }
 
     startRegistration();
     startDoctors();
+    waitForRoles();
     setRawTerminal();
     startGenerator();
 
-    handleKeyboard();
+    watchStdin();
+    armTimeLimit();
+    armSweep();
+    armAutoscale();
+    armBreakPlanner();
+    armWards();
+    runEventLoop();
 
     // Zakończenie
     restoreTerminal();
@@ -453,6 +1752,15 @@ int main(int argc, char* argv[]) {
 
     shutdownGenerator();
     shutdownRemaining();
+    printHandoffReport();
+    printRegistrationReport();
+    printStaffReport();
+    printAdmissionReport();
+    printOverloadReport();
+    printBreakReport();
+    printTriageReport();
+    printWardReport();
+    printSaturationReport();
 
     printf("\n=== Symulacja zakończona ===\n");
     return 0;
@@ -3,10 +3,10 @@
  * @brief Proces pacjenta SOR
  * 
  * Realizuje pełną ścieżkę pacjenta przez SOR:
- * A. Wejście do poczekalni (ograniczona pojemność N)
+ * A. Wejście do poczekalni (ograniczona pojemność N, scenariusz: n)
  * B. Rejestracja (kolejka VIP lub zwykła)
  * C. Triaż u lekarza POZ
- * D. Leczenie u specjalisty
+ * D. Leczenie u specjalisty (wynik "oddział": czekanie w SOR na łóżko, ward_beds_*)
  * E. Wyjście z SOR
  * 
  * Dla dzieci (<18 lat) używane są dwa wątki:
@@ -15,6 +15,7 @@
  */
 
 #include "sor_common.hpp"
+#include "sor_ward.hpp"
 
 // ============================================================================
 // STRUKTURA DANYCH PACJENTA
@@ -29,6 +30,11 @@ struct PatientData {
     // Bilety wejścia do poczekalni (przydzielone przez generator)
     long gate_ticket1;          // Zawsze
     long gate_ticket2;          // Tylko dzieci (0 = brak)
+    unsigned long long identity; // Syntetyczna tożsamość (klucz rejestru pacjentów)
+    long long arrival_ns;       // Start procesu — początek czasu pobytu
+    long long stage_start_ns;   // Początek bieżącego etapu (wejście albo poprzednia odpowiedź)
+    int prev_visits;            // Historia z rejestru (od rejestracji) — przekazywana do POZ
+    TriageColor prev_color;
 
     // Zasoby IPC
     int semid;
@@ -60,6 +66,9 @@ struct PatientData {
 
 static volatile sig_atomic_t g_shutdown = 0;
 
+static SharedState* g_state = nullptr;   // Kopia data.state dla helperów IPC
+static bool g_spin_allowed = false;      // Spin ma sens tylko gdy nadawca ma inny CPU
+
 // ============================================================================
 // HELPERY
 // ============================================================================
@@ -71,33 +80,100 @@ static bool safeMsgsnd(int qid, void* buf, size_t size, const char* ctx, int pat
             SOR_WARN("pacjent %d: msgsnd %s", patient_id, ctx);
         return false;
     }
+    if (g_state) bumpHandoffSeq(g_state);
     return true;
 }
 
-/// Bezpieczny msgrcv z retry na EINTR — zwraca true jeśli sukces
+/// Bezpieczny msgrcv z retry na EINTR — zwraca true jeśli sukces.
+/// EINTR po SIGTERM/SIGUSR2 kończy czekanie od razu (szybkie zamknięcie symulacji).
 static bool safeMsgrcv(int qid, void* buf, size_t size, long mtype) {
     while (msgrcv(qid, buf, size, mtype, 0) == -1) {
-        if (errno != EINTR) return false;
+        if (errno != EINTR || g_shutdown) return false;
+    }
+    return true;
+}
+
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief msgrcv spin-then-block: najpierw próba IPC_NOWAIT, potem do budżetu ns
+ *        obserwowanie handoff_seq (bez syscalli) i ponowna próba po każdej zmianie,
+ *        na końcu zwykły blokujący safeMsgrcv.
+ *
+ * Budżet = 2 × średnia krocząca czasu czekania w danym miejscu, ale 0 gdy średnia
+ * przekracza SPIN_MAX_US — długie czekanie (np. bramka przy pełnej poczekalni)
+ * od razu blokuje i nie pali CPU.
+ */
+static bool adaptiveMsgrcv(WaitSite site, int qid, void* buf, size_t size, long mtype) {
+    if (!SPIN_WAIT_ENABLED || !g_spin_allowed || !g_state)
+        return safeMsgrcv(qid, buf, size, mtype);
+
+    SpinTuner& tuner = g_state->spin[site];
+    long long t0 = monotonicNs();
+    long long ewma = __atomic_load_n(&tuner.ewma_wait_ns, __ATOMIC_RELAXED);
+    long long budget = (ewma < SPIN_MAX_US * 1000LL) ? 2 * ewma : 0;
+    if (budget > SPIN_MAX_US * 1000LL) budget = SPIN_MAX_US * 1000LL;
+
+    bool got = false;
+    unsigned int seq = __atomic_load_n(&g_state->handoff_seq, __ATOMIC_ACQUIRE);
+    if (msgrcv(qid, buf, size, mtype, IPC_NOWAIT) != -1) {
+        got = true;
+    } else {
+        long long now = t0;
+        while (now - t0 < budget) {
+            unsigned int cur = __atomic_load_n(&g_state->handoff_seq, __ATOMIC_ACQUIRE);
+            if (cur != seq) {
+                seq = cur;
+                if (msgrcv(qid, buf, size, mtype, IPC_NOWAIT) != -1) { got = true; break; }
+            }
+            cpuRelax();
+            now = monotonicNs();
+        }
     }
+
+    if (got) {
+        __atomic_fetch_add(&tuner.spin_hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&tuner.blocks, 1, __ATOMIC_RELAXED);
+        if (!safeMsgrcv(qid, buf, size, mtype)) return false;
+    }
+
+    // EWMA z wagą 1/8 — nowy pomiar zawsze (także po zablokowaniu), więc budżet
+    // wraca do zera gdy odpowiedzi zwalniają i rośnie gdy znów przychodzą szybko
+    long long waited = monotonicNs() - t0;
+    __atomic_store_n(&tuner.ewma_wait_ns, ewma + (waited - ewma) / 8, __ATOMIC_RELAXED);
     return true;
 }
 
-/// Czekaj na bilet w kolejce porządkującej (blokujące)
-static bool orderQueueWait(int qid, long ticket) {
+/// Czekaj na bilet w kolejce porządkującej (spin-then-block, budżet miejsca site)
+static bool orderQueueWait(WaitSite site, int qid, long ticket) {
     if (ticket <= 0) return true;
     GateToken tok;
-    return safeMsgrcv(qid, &tok, GATE_TOKEN_SIZE, ticket);
+    return adaptiveMsgrcv(site, qid, &tok, GATE_TOKEN_SIZE, ticket);
 }
 
-/// Oddaj bilet w kolejce porządkującej (odblokuj następnego)
-static void orderQueueRelease(int qid, long ticket, int patient_id, const char* ctx) {
+/// Oddaj bilet w kolejce porządkującej (odblokuj następnego; stride > 1 — bilety przeplecione)
+static void orderQueueRelease(int qid, long ticket, int patient_id, const char* ctx, long stride = 1) {
     if (ticket <= 0) return;
     GateToken rel;
-    rel.mtype = ticket + 1;
+    rel.mtype = ticket + stride;
     rel.data[0] = 0;
     safeMsgsnd(qid, &rel, GATE_TOKEN_SIZE, ctx, patient_id);
 }
 
+/// Czas etapu od wejścia / poprzedniej odpowiedzi do odpowiedzi etapu (krzywa nasycenia -S)
+static void recordStage(PatientData* d, HandoffStage stage) {
+    long long now = monotonicNs();
+    recordLatency(d->state->stage_time[stage], now - d->stage_start_ns);
+    d->stage_start_ns = now;
+}
+
 /// Czy powinniśmy przerwać (shutdown)
 static inline bool shouldStop(PatientData* d) {
     return g_shutdown || d->state->shutdown;
@@ -114,6 +190,11 @@ static void initIPC(PatientData* data) {
 
     data->state = (SharedState*)shmat(shmid, nullptr, 0);
     if (data->state == (void*)-1) SOR_FATAL("pacjent %d: shmat", data->id);
+    initSimClock(data->state);
+    initRandom(data->state);
+    initScenario(data->state);
+    g_state = data->state;
+    g_spin_allowed = sysconf(_SC_NPROCESSORS_ONLN) > 1;
 
     key_t sem_key = getIPCKey(SEM_KEY_ID);
     data->semid = semget(sem_key, SEM_COUNT, 0);
@@ -159,15 +240,15 @@ static void enterWaitingRoom(PatientData* data) {
     int step = data->is_child ? 2 : 1;
 
     // Czekaj na bilet(y) gate
-    if (!safeMsgrcv(gate, &token, GATE_TOKEN_SIZE, data->gate_ticket1)) return;
+    if (!adaptiveMsgrcv(WAIT_GATE, gate, &token, GATE_TOKEN_SIZE, data->gate_ticket1)) return;
     if (data->is_child) {
-        if (!safeMsgrcv(gate, &token, GATE_TOKEN_SIZE, data->gate_ticket2)) return;
+        if (!adaptiveMsgrcv(WAIT_GATE, gate, &token, GATE_TOKEN_SIZE, data->gate_ticket2)) return;
     }
 
     // Czekaj na kolej w kolejce porządkującej (FIFO logowania wejścia)
     GateToken order_token;
-    if (!safeMsgrcv(data->state->order_gate_log_msgid, &order_token, GATE_TOKEN_SIZE,
-                    data->gate_ticket1))
+    if (!adaptiveMsgrcv(WAIT_ORDER_LOG, data->state->order_gate_log_msgid, &order_token, GATE_TOKEN_SIZE,
+                        data->gate_ticket1))
         return;
 
     semWait(data->semid, SEM_SHM_MUTEX);
@@ -175,10 +256,10 @@ static void enterWaitingRoom(PatientData* data) {
     int count = data->state->patients_in_sor;
     if (data->is_child) {
         logMessage(data->state, data->semid, "Pacjent %d [Opiekun] wchodzi do budynku (%d/%d)",
-                  data->id, count, N);
+                  data->id, count, g_scenario.p.waiting_capacity);
     } else {
         logMessage(data->state, data->semid, "Pacjent %d wchodzi do budynku (%d/%d)",
-                  data->id, count, N);
+                  data->id, count, g_scenario.p.waiting_capacity);
     }
     semSignal(data->semid, SEM_SHM_MUTEX);
 
@@ -197,6 +278,7 @@ static void doRegistration(PatientData* data) {
     msg.patient_pid = getpid();
     msg.age = data->age;
     msg.is_vip = data->is_vip ? 1 : 0;
+    msg.identity = data->identity;
 
     // Dołącz do kolejki rejestracji (pod ochroną tokenu gate — FIFO)
     semWait(data->semid, SEM_SHM_MUTEX);
@@ -208,8 +290,10 @@ static void doRegistration(PatientData* data) {
                   data->id, data->is_vip ? " [VIP]" : "");
     }
     data->state->reg_queue_count++;
+    data->state->reg_arrivals++;
     semSignal(data->semid, SEM_SHM_MUTEX);
 
+    msg.enqueued_ns = monotonicNs();
     safeMsgsnd(data->msgid, &msg, sizeof(SORMessage) - sizeof(long), "kolejka rejestracji", data->id);
 
     // Oddaj token gate — następny pacjent może wejść
@@ -221,42 +305,45 @@ static void doRegistration(PatientData* data) {
         data->holding_gate_token = false;
     }
 
-    semSignal(data->semid, SEM_REG_QUEUE_CHANGED);
+    notifyRegQueueChanged(data->state, data->semid);
 
     // Czekaj na odpowiedź od rejestracji
     SORMessage response;
-    if (!safeMsgrcv(data->msgid, &response, sizeof(SORMessage) - sizeof(long),
-                    MSG_REGISTRATION_RESPONSE + data->id))
+    if (!adaptiveMsgrcv(WAIT_REGISTRATION, data->msgid, &response, sizeof(SORMessage) - sizeof(long),
+                        MSG_REGISTRATION_RESPONSE + data->id))
         return;
+    recordLatency(data->state->handoff[HANDOFF_REGISTRATION], monotonicNs() - response.sent_ns);
+    recordStage(data, HANDOFF_REGISTRATION);
 
     data->triage_ticket = response.triage_ticket;
+    data->prev_visits = response.prev_visits;
+    data->prev_color = response.prev_color;
 }
 
 /**
- * @brief Triaż u lekarza POZ — bilet porządkujący gwarantuje FIFO
+ * @brief Triaż u lekarza POZ — mtype = bilet triażowy; wolni POZ podejmują bilety
+ *        po kolei (triage_dispatch_next), więc FIFO bez przekazywania tokenu
  */
 static void doTriage(PatientData* data) {
     SORMessage msg{};
-    msg.mtype = MSG_PATIENT_TO_TRIAGE;
+    msg.mtype = data->triage_ticket;
     msg.patient_id = data->id;
     msg.patient_pid = getpid();
     msg.age = data->age;
     msg.is_vip = data->is_vip ? 1 : 0;
+    msg.identity = data->identity;
+    msg.prev_visits = data->prev_visits;
+    msg.prev_color = data->prev_color;
 
-    // Czekaj na swoją kolej w triażu
-    orderQueueWait(data->state->order_triage_msgid, data->triage_ticket);
-
-    safeMsgsnd(data->msgid, &msg, sizeof(SORMessage) - sizeof(long), "triaż", data->id);
-
-    // Oddaj token triażu
-    orderQueueRelease(data->state->order_triage_msgid, data->triage_ticket,
-                      data->id, "order_triage");
+    safeMsgsnd(data->state->triage_msgid, &msg, sizeof(SORMessage) - sizeof(long), "triaż", data->id);
 
     // Czekaj na odpowiedź od POZ
     SORMessage response;
-    if (!safeMsgrcv(data->msgid, &response, sizeof(SORMessage) - sizeof(long),
-                    MSG_TRIAGE_RESPONSE + data->id))
+    if (!adaptiveMsgrcv(WAIT_TRIAGE, data->msgid, &response, sizeof(SORMessage) - sizeof(long),
+                        MSG_TRIAGE_RESPONSE + data->id))
         return;
+    recordLatency(data->state->handoff[HANDOFF_TRIAGE], monotonicNs() - response.sent_ns);
+    recordStage(data, HANDOFF_TRIAGE);
 
     data->color = response.color;
     data->assigned_doctor = response.assigned_doctor;
@@ -267,17 +354,79 @@ static void doTriage(PatientData* data) {
     }
 }
 
+/**
+ * @brief Czekanie w SOR na łóżko oddziału (boarding) — pacjent nadal zajmuje miejsce
+ *        w poczekalni, więc pełny oddział blokuje wejście nowych. Bilet wyjścia dopiero
+ *        po przyjęciu (lekarz go nie przydziela), żeby nie wstrzymywać wyjść innych.
+ *
+ * Łóżka przydzielane FIFO wg biletu oddziału: na SEM_WARD_* czeka tylko czoło kolejki,
+ * reszta na swój token w order_board_msgid.
+ */
+static void boardWard(PatientData* data) {
+    DoctorType dept = data->assigned_doctor;
+    SharedState* st = data->state;
+    long long start = monotonicNs();
+
+    semWait(data->semid, SEM_SHM_MUTEX);
+    if (++st->ward_boarding[dept] > st->ward_boarding_peak[dept])
+        st->ward_boarding_peak[dept] = st->ward_boarding[dept];
+    long board_ticket = wardBoardMtype(dept, st->ward_board_next_ticket[dept]++);
+    semSignal(data->semid, SEM_SHM_MUTEX);
+
+    struct sembuf op{};
+    op.sem_num = getWardSemIndex(dept);
+    op.sem_op = -1;
+    op.sem_flg = IPC_NOWAIT;
+    // Bez spinu: czekanie na łóżko trwa godziny czasu symulacji
+    GateToken tok;
+    bool at_head = safeMsgrcv(st->order_board_msgid, &tok, GATE_TOKEN_SIZE, board_ticket);
+    bool admitted = at_head && semop(data->semid, &op, 1) == 0;
+    if (at_head && !admitted) {
+        logMessage(st, data->semid, "Pacjent %d%s czeka w SOR na łóżko — oddział %s pełny",
+                  data->id, data->is_child ? " [Dziecko]" : "", getWardName(dept));
+        op.sem_flg = 0;
+        while (!(admitted = semop(data->semid, &op, 1) == 0)) {
+            if (errno != EINTR || shouldStop(data)) break;   // EIDRM/EINVAL — IPC usunięte
+        }
+    }
+    if (at_head) orderQueueRelease(st->order_board_msgid, board_ticket, data->id, "order_board", DOCTOR_COUNT);
+
+    long long stay_ns = 0;
+    if (admitted) {
+        RngScope rng(RNG_ROLE_WARD, (uint32_t)data->id);
+        stay_ns = randomWardStayNs(dept);
+    }
+    long long now = monotonicNs();
+    semWait(data->semid, SEM_SHM_MUTEX);
+    st->ward_boarding[dept]--;
+    if (admitted) {
+        wardOccupy(st, dept, now + stay_ns);
+        st->ward_admitted[dept]++;
+        data->exit_ticket = st->exit_next_ticket++;
+    }
+    semSignal(data->semid, SEM_SHM_MUTEX);
+    if (!admitted) return;
+
+    recordLatency(st->ward_boarding_wait[dept], now - start);
+    logMessage(st, data->semid, "Pacjent %d%s przyjęty na oddział %s (czekał %.1f s, pobyt %.1f h)",
+              data->id, data->is_child ? " [Dziecko]" : "", getWardName(dept),
+              (now - start) * g_time_scale / 1e9, stay_ns * g_time_scale / 3.6e12);
+}
+
 /**
  * @brief Leczenie u specjalisty — POZ już wstawił do kolejki specjalisty,
  *        pacjent czeka tylko na wynik.
  */
 static void doSpecialist(PatientData* data) {
     SORMessage response;
-    if (!safeMsgrcv(data->msgid, &response, sizeof(SORMessage) - sizeof(long),
-                    MSG_SPECIALIST_RESPONSE + data->id))
+    if (!adaptiveMsgrcv(WAIT_SPECIALIST, data->msgid, &response, sizeof(SORMessage) - sizeof(long),
+                        MSG_SPECIALIST_RESPONSE + data->id))
         return;
+    recordLatency(data->state->handoff[HANDOFF_SPECIALIST], monotonicNs() - response.sent_ns);
+    recordStage(data, HANDOFF_SPECIALIST);
 
     data->exit_ticket = response.exit_ticket;
+    if (response.outcome == 1 && wardLimited(data->assigned_doctor)) boardWard(data);
 }
 
 /**
@@ -285,7 +434,7 @@ static void doSpecialist(PatientData* data) {
  */
 static void exitSOR(PatientData* data) {
     // Czekaj na swoją kolej wyjścia (FIFO)
-    orderQueueWait(data->state->order_exit_msgid, data->exit_ticket);
+    orderQueueWait(WAIT_EXIT, data->state->order_exit_msgid, data->exit_ticket);
 
     int gate = data->state->gate_msgid;
     int step = data->is_child ? 2 : 1;
@@ -301,6 +450,7 @@ static void exitSOR(PatientData* data) {
         if (data->state->patients_in_sor > 0) data->state->patients_in_sor--;
     }
     if (data->state->active_patient_count > 0) data->state->active_patient_count--;
+    if (!shouldStop(data)) data->state->completed_patients++;
 
     // Wyślij tokeny gate (obudź następnych czekających)
     for (int i = 0; i < step; i++) {
@@ -314,6 +464,12 @@ static void exitSOR(PatientData* data) {
     // Oddaj token wyjścia
     orderQueueRelease(data->state->order_exit_msgid, data->exit_ticket,
                       data->id, "order_exit");
+
+    // Zwolnij miejsce w limicie procesów — budzi generator czekający na SEM_ADMISSION
+    if (data->state->max_patients > 0) semSignal(data->semid, SEM_ADMISSION);
+
+    if (!shouldStop(data))
+        recordLatency(data->state->sojourn, monotonicNs() - data->arrival_ns);
 }
 
 // ============================================================================
@@ -366,7 +522,7 @@ static void* childThread(void* arg) {
 
 int main(int argc, char* argv[]) {
     if (argc < 5) {
-        fprintf(stderr, "Użycie: pacjent <id> <wiek> <vip> <ticket1> [ticket2]\n");
+        fprintf(stderr, "Użycie: pacjent <id> <wiek> <vip> <ticket1> [ticket2] [tożsamość]\n");
         return EXIT_FAILURE;
     }
 
@@ -377,6 +533,9 @@ int main(int argc, char* argv[]) {
     data.is_child = data.age < 18;
     data.gate_ticket1 = atol(argv[4]);
     data.gate_ticket2 = (argc >= 6) ? atol(argv[5]) : 0;
+    data.arrival_ns = monotonicNs();
+    data.stage_start_ns = data.arrival_ns;
+    data.identity = (argc >= 7) ? strtoull(argv[6], nullptr, 10) : 0;
 
     setupSignals();
     initIPC(&data);
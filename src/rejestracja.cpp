@@ -3,13 +3,16 @@
  * @brief Proces rejestracji SOR — jedno okienko = jeden wątek
  * 
  * Wątek okienka 1: zawsze aktywny
- * Wątek okienka 2: uruchamiany gdy kolejka >= K_OPEN, zatrzymywany gdy < K_CLOSE
- * Wątek kontrolera: monitoruje długość kolejki i steruje okienkiem 2
+ * Wątki okienek 2..M: okienko i+1 uruchamiane gdy kolejka >= REG_OPEN_AT[i],
+ *   zatrzymywane gdy < REG_CLOSE_AT[i]; otwierane i zamykane w kolejności stosu
+ * Wątek kontrolera: monitoruje kolejkę i steruje okienkami 2..M wg REG_CTRL_MODE
+ *   (progi na długości kolejki albo prognoza z EWMA napływu i czasu oczekiwania)
  * 
  * VIP obsługiwane priorytetowo (ujemny mtype w msgrcv).
  */
 
 #include "sor_common.hpp"
+#include "sor_registry.hpp"
 
 // ============================================================================
 // ZMIENNE GLOBALNE
@@ -21,12 +24,29 @@ static int g_msgid = -1;
 
 static volatile sig_atomic_t g_shutdown = 0;
 
-// Kontrola wątku okienka 2
-static pthread_t g_window2_thread;
-static pthread_mutex_t g_window2_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t g_window2_cond = PTHREAD_COND_INITIALIZER;
-static volatile bool g_window2_active = false;
-static volatile bool g_window2_should_run = false;
+static Registry g_registry;   // Pusty (header == nullptr) gdy rejestr wyłączony
+
+// Wątki okienek 2..M (indeks = numer okienka - 1; [0] = wątek główny).
+// Tworzone przy otwarciu, anulowane (pthread_cancel) przy zamknięciu — tylko kontroler
+// i wątek główny po jego zakończeniu dotykają tej tablicy.
+struct WindowCtl {
+    pthread_t thread;
+    bool running;
+};
+static WindowCtl g_windows[REG_MAX_WINDOWS];
+
+// Prognoza dla kontrolera predykcyjnego (czasy w ms symulacji)
+struct RegForecast {
+    double arrival_rate;        // EWMA napływu [pacjentów/s]
+    double wait_mean_ms;        // EWMA czasu oczekiwania w kolejce
+    double wait_var_ms2;        // EWMA wariancji czasu oczekiwania
+    bool have_wait;
+    long long last_arrivals;    // reg_arrivals przy ostatniej próbce napływu
+    long long last_sample_ns;
+    long long last_change_ns;   // Ostatnia zmiana liczby okienek
+};
+static RegForecast g_forecast;
+static pthread_mutex_t g_forecast_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 // ============================================================================
 // HELPERY
@@ -45,6 +65,9 @@ static void initIPC() {
 
     g_state = (SharedState*)shmat(shmid, nullptr, 0);
     if (g_state == (void*)-1) SOR_FATAL("rejestracja: shmat");
+    initSimClock(g_state);
+    initRandom(g_state);
+    initScenario(g_state);
 
     key_t sem_key = getIPCKey(SEM_KEY_ID);
     g_semid = semget(sem_key, SEM_COUNT, 0);
@@ -60,7 +83,6 @@ static void initIPC() {
 // ============================================================================
 
 static void signalHandler(int sig) {
-    // SIGUSR1 — tylko przerywa msgrcv (EINTR) bez ustawiania shutdown
     if (sig == SIGUSR2 || sig == SIGTERM || sig == SIGINT)
         g_shutdown = 1;
 }
@@ -71,7 +93,6 @@ static void setupSignals() {
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = 0;
 
-    sigaction(SIGUSR1, &sa, nullptr);  // Budzenie wątku okienka 2 (EINTR)
     sigaction(SIGUSR2, &sa, nullptr);
     sigaction(SIGTERM, &sa, nullptr);
     sigaction(SIGINT, &sa, nullptr);
@@ -81,7 +102,42 @@ static void setupSignals() {
 // OBSŁUGA PACJENTA
 // ============================================================================
 
+/// Aktualizuje EWMA średniej i wariancji oczekiwania (wołane przez wątki okienek)
+static void recordRegWait(double wait_ms) {
+    pthread_mutex_lock(&g_forecast_mutex);
+    RegForecast& f = g_forecast;
+    if (!f.have_wait) {
+        f.wait_mean_ms = wait_ms;
+        f.wait_var_ms2 = 0.0;
+        f.have_wait = true;
+    } else {
+        double diff = wait_ms - f.wait_mean_ms;
+        f.wait_mean_ms += REG_EWMA_ALPHA * diff;
+        f.wait_var_ms2 = (1.0 - REG_EWMA_ALPHA) * (f.wait_var_ms2 + REG_EWMA_ALPHA * diff * diff);
+    }
+    pthread_mutex_unlock(&g_forecast_mutex);
+}
+
+/// Szuka pacjenta w rejestrze i dołącza historię do wiadomości; true = pacjent znany
+static bool lookupRegistry(SORMessage& msg) {
+    if (!g_registry.header) return false;
+
+    long long t0 = monotonicNs();
+    RegistryRecord history{};
+    bool known = registryVisit(g_registry, msg.identity, &history);
+    recordLatency(g_state->registry.lookup, monotonicNs() - t0);
+
+    if (!known) return false;
+    __atomic_fetch_add(&g_state->registry.hits, 1, __ATOMIC_RELAXED);
+    msg.prev_visits = history.visits;
+    msg.prev_color = (TriageColor)history.last_color;
+    return true;
+}
+
 static void processPatient(int window_id, SORMessage& msg) {
+    long long start_ns = monotonicNs();
+    if constexpr (REG_CTRL_MODE == REG_CTRL_PREDICTIVE)
+        recordRegWait((start_ns - msg.enqueued_ns) * g_time_scale / 1e6);
     logMessage(g_state, g_semid, "Pacjent %d podchodzi do okienka rejestracji %d%s",
               msg.patient_id, window_id, msg.is_vip ? " [VIP]" : "");
 
@@ -89,67 +145,101 @@ static void processPatient(int window_id, SORMessage& msg) {
     if (g_state->reg_queue_count > 0) g_state->reg_queue_count--;
     semSignal(g_semid, SEM_SHM_MUTEX);
 
-    semSignal(g_semid, SEM_REG_QUEUE_CHANGED);
+    notifyRegQueueChanged(g_state, g_semid);
 
-    randomSleep(REGISTRATION_MIN_MS, REGISTRATION_MAX_MS);
+    SORMessage response = msg;
+    {
+        RngScope rng(RNG_ROLE_REGISTRATION, (uint32_t)msg.patient_id);
+        if (lookupRegistry(response)) {
+            logMessage(g_state, g_semid, "Pacjent %d znaleziony w rejestrze (wizyt: %d, ostatnio: %s)",
+                      msg.patient_id, response.prev_visits, getColorName(response.prev_color));
+            randomSleep(g_scenario.p.registration_known_min_ms, g_scenario.p.registration_known_max_ms);
+        } else {
+            randomSleep(g_scenario.p.registration_min_ms, g_scenario.p.registration_max_ms);
+        }
+    }
 
     // Przydziel bilet triażowy (pod mutexem — gwarantuje FIFO)
     semWait(g_semid, SEM_SHM_MUTEX);
-    int triage_ticket = g_state->triage_next_ticket++;
+    response.triage_ticket = g_state->triage_next_ticket++;
     semSignal(g_semid, SEM_SHM_MUTEX);
 
-    SORMessage response = msg;
     response.mtype = MSG_REGISTRATION_RESPONSE + msg.patient_id;
-    response.triage_ticket = triage_ticket;
+    response.sent_ns = monotonicNs();
 
     if (msgsnd(g_msgid, &response, sizeof(SORMessage) - sizeof(long), 0) == -1) {
         if (errno != EINTR && errno != EIDRM)
             SOR_WARN("rejestracja: msgsnd odpowiedź pacjent %d", msg.patient_id);
+    } else {
+        bumpHandoffSeq(g_state);
     }
 
     logMessage(g_state, g_semid, "Pacjent %d przekazany do triażu, czeka na lekarza POZ",
               msg.patient_id);
+
+    // Statystyki okienka — pisze tylko wątek tego okienka, dyrektor czyta po jego zakończeniu
+    RegWindowStats& ws = g_state->reg_window[window_id - 1];
+    ws.served++;
+    ws.busy_ns += monotonicNs() - start_ns;
 }
 
 // ============================================================================
-// WĄTEK OKIENKA 2
+// STAN OKIENEK
+// ============================================================================
+
+/// Oznacza okienko jako czynne/nieczynne i rozlicza czas otwarcia (pod SEM_SHM_MUTEX)
+static void setWindowOpen(int window_id, bool open) {
+    long long now = monotonicNs();
+    RegWindowStats& ws = g_state->reg_window[window_id - 1];
+
+    semWait(g_semid, SEM_SHM_MUTEX);
+    if (open && !ws.open) {
+        ws.open = 1;
+        ws.open_events++;
+        ws.opened_at_ns = now;
+        g_state->reg_windows_open++;
+    } else if (!open && ws.open) {
+        ws.open = 0;
+        ws.open_ns += now - ws.opened_at_ns;
+        g_state->reg_windows_open--;
+    }
+    semSignal(g_semid, SEM_SHM_MUTEX);
+}
+
+static void logWindowStats() {
+    for (int i = 0; i < g_scenario.p.reg_windows; i++) {
+        const RegWindowStats& ws = g_state->reg_window[i];
+        double util = ws.open_ns > 0 ? 100.0 * ws.busy_ns / ws.open_ns : 0.0;
+        logMessage(g_state, g_semid,
+                  "[RegStat] Okienko %d: obsłużono %lld, otwarć %d, otwarte %.2f s, zajętość %.1f%%",
+                  i + 1, ws.served, ws.open_events, ws.open_ns / 1e9, util);
+    }
+}
+
+// ============================================================================
+// WĄTKI OKIENEK 2..M
 // ============================================================================
 
 static void* windowThread(void* arg) {
     int window_id = (int)(intptr_t)arg;
 
+    // Anulowanie tylko w msgrcv — pacjent w trakcie obsługi jest zawsze dokończony
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+    logMessage(g_state, g_semid, "Okienko rejestracji %d rozpoczyna pracę", window_id);
+
     while (!shouldStop()) {
-        // Czekaj na aktywację
-        pthread_mutex_lock(&g_window2_mutex);
-        while (!g_window2_should_run && !shouldStop())
-            pthread_cond_wait(&g_window2_cond, &g_window2_mutex);
-
-        if (shouldStop()) { pthread_mutex_unlock(&g_window2_mutex); break; }
-
-        g_window2_active = true;
-        pthread_mutex_unlock(&g_window2_mutex);
-
-        logMessage(g_state, g_semid, "Okienko rejestracji %d rozpoczyna pracę", window_id);
-
-        // Obsługuj pacjentów dopóki okienko jest aktywne
-        while (g_window2_should_run && !shouldStop()) {
-            SORMessage msg;
-            ssize_t ret = msgrcv(g_msgid, &msg, sizeof(SORMessage) - sizeof(long),
-                                 -MSG_PATIENT_TO_REGISTRATION, 0);
-            if (ret == -1) {
-                if (errno == EINTR) continue;
-                if (errno == EIDRM || errno == EINVAL) break;
-                SOR_WARN("rejestracja okienko %d: msgrcv", window_id);
-                continue;
-            }
-            processPatient(window_id, msg);
+        SORMessage msg;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+        ssize_t ret = msgrcv(g_msgid, &msg, sizeof(SORMessage) - sizeof(long),
+                             -MSG_PATIENT_TO_REGISTRATION, 0);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+        if (ret == -1) {
+            if (errno == EINTR) continue;
+            if (errno == EIDRM || errno == EINVAL) break;
+            SOR_WARN("rejestracja okienko %d: msgrcv", window_id);
+            continue;
         }
-
-        pthread_mutex_lock(&g_window2_mutex);
-        g_window2_active = false;
-        pthread_mutex_unlock(&g_window2_mutex);
-
-        logMessage(g_state, g_semid, "Okienko rejestracji %d kończy pracę", window_id);
+        processPatient(window_id, msg);
     }
     return nullptr;
 }
@@ -158,53 +248,156 @@ static void* windowThread(void* arg) {
 // KONTROLER KOLEJKI
 // ============================================================================
 
+/// Uruchamia wątek okienka
+static void openWindow(int window_id) {
+    WindowCtl& ctl = g_windows[window_id - 1];
+    setWindowOpen(window_id, true);
+    if (pthread_create(&ctl.thread, nullptr, windowThread, (void*)(intptr_t)window_id) != 0)
+        SOR_FATAL("pthread_create okienko %d", window_id);
+    ctl.running = true;
+}
+
+/// Zatrzymuje okienko — anulowanie w msgrcv działa od razu, obsługiwany pacjent
+/// jest dokończony przed wyjściem wątku
+static void closeWindow(int window_id) {
+    WindowCtl& ctl = g_windows[window_id - 1];
+    if (ctl.running) {
+        pthread_cancel(ctl.thread);
+        pthread_join(ctl.thread, nullptr);
+        ctl.running = false;
+        logMessage(g_state, g_semid, "Okienko rejestracji %d kończy pracę", window_id);
+    }
+    // Okres otwarcia kończy się dopiero gdy okienko obsłużyło ostatniego pacjenta
+    setWindowOpen(window_id, false);
+}
+
+/// Sterowanie progowe — stos okienek wg REG_OPEN_AT/REG_CLOSE_AT (k_open/k_close ze scenariusza)
+static void thresholdControl(int queue_count, int open) {
+    // Otwieraj kolejne dopóki kolejka przekracza ich progi,
+    // zamykaj od ostatniego dopóki spadła poniżej progu zamknięcia
+    if (open < g_scenario.p.reg_windows && queue_count >= g_scenario.p.reg_open_at[open]) {
+        while (open < g_scenario.p.reg_windows && queue_count >= g_scenario.p.reg_open_at[open]) {
+            logMessage(g_state, g_semid, "[RegCtrl] Otwieram okienko %d (kolejka: %d >= %d)",
+                      open + 1, queue_count, g_scenario.p.reg_open_at[open]);
+            openWindow(++open);
+        }
+    } else {
+        while (open > 1 && queue_count < g_scenario.p.reg_close_at[open - 1] && !shouldStop()) {
+            logMessage(g_state, g_semid, "[RegCtrl] Zamykam okienko %d (kolejka: %d < %d)",
+                      open, queue_count, g_scenario.p.reg_close_at[open - 1]);
+            closeWindow(open--);
+        }
+    }
+}
+
+/// Przepustowość jednego okienka [pacjentów/s] przy średnim czasie rejestracji ze scenariusza
+static double regServiceRate() {
+    return 2000.0 / (g_scenario.p.registration_min_ms + g_scenario.p.registration_max_ms);
+}
+
+/// Prognozowany czas oczekiwania [ms] pacjenta dołączającego za REG_FORECAST_HORIZON_MS
+static double predictWaitMs(int queue_count, double arrival_rate, int windows) {
+    double capacity = windows * regServiceRate();
+    double queue_at_horizon = queue_count + (arrival_rate - capacity) * REG_FORECAST_HORIZON_MS / 1000.0;
+    if (queue_at_horizon < 0.0) queue_at_horizon = 0.0;
+    return queue_at_horizon / capacity * 1000.0;
+}
+
+/// Sterowanie predykcyjne — EWMA napływu i oczekiwania, cel p95, min. czas trwania zmiany
+static void predictiveControl(int queue_count, int open, long long arrivals) {
+    long long now = monotonicNs();
+
+    pthread_mutex_lock(&g_forecast_mutex);
+    RegForecast& f = g_forecast;
+    double dt_ms = (now - f.last_sample_ns) * g_time_scale / 1e6;
+    if (dt_ms >= REG_CTRL_TICK_MS) {
+        double sample = (arrivals - f.last_arrivals) * 1000.0 / dt_ms;
+        f.arrival_rate += REG_EWMA_ALPHA * (sample - f.arrival_rate);
+        f.last_arrivals = arrivals;
+        f.last_sample_ns = now;
+    }
+    double rate = f.arrival_rate;
+    double p95_ms = f.have_wait ? f.wait_mean_ms + 1.645 * sqrt(f.wait_var_ms2) : 0.0;
+    double dwell_ms = (now - f.last_change_ns) * g_time_scale / 1e6;
+    pthread_mutex_unlock(&g_forecast_mutex);
+
+    const double target = REG_WAIT_P95_TARGET_MS;
+    double predicted = predictWaitMs(queue_count, rate, open);
+
+    if (open < g_scenario.p.reg_windows) {
+        // Prognoza przekracza cel — otwórz tyle okienek, ile potrzeba do jego spełnienia
+        if (predicted > target) {
+            int want = open;
+            while (want < g_scenario.p.reg_windows && predictWaitMs(queue_count, rate, want) > target) want++;
+            logMessage(g_state, g_semid,
+                      "[RegCtrl] Otwieram okienka do %d: prognoza oczekiwania %.0f ms > cel p95 %d ms "
+                      "(napływ %.2f/s, kolejka %d, przepustowość %.2f/s)",
+                      want, predicted, REG_WAIT_P95_TARGET_MS, rate, queue_count,
+                      open * regServiceRate());
+            while (open < want) openWindow(++open);
+            g_forecast.last_change_ns = now;
+            return;
+        }
+        // Obserwowane p95 ponad celem przy niepustej kolejce — jedno okienko więcej,
+        // ale nie częściej niż co REG_MIN_DWELL_MS (p95 z EWMA reaguje z opóźnieniem)
+        if (p95_ms > target && queue_count > 0 && dwell_ms >= REG_MIN_DWELL_MS) {
+            logMessage(g_state, g_semid,
+                      "[RegCtrl] Otwieram okienko %d: zmierzone p95 %.0f ms > cel %d ms (kolejka %d)",
+                      open + 1, p95_ms, REG_WAIT_P95_TARGET_MS, queue_count);
+            openWindow(++open);
+            g_forecast.last_change_ns = now;
+            return;
+        }
+    }
+
+    // Zamknięcie: po min. czasie od zmiany, gdy n-1 okienek wystarczy z zapasem
+    if (open > 1 && dwell_ms >= REG_MIN_DWELL_MS && p95_ms < target
+        && rate < (open - 1) * regServiceRate() * REG_CLOSE_MAX_UTIL
+        && predictWaitMs(queue_count, rate, open - 1) < target / 2) {
+        logMessage(g_state, g_semid,
+                  "[RegCtrl] Zamykam okienko %d: napływ %.2f/s < %.0f%% przepustowości %d okienek, "
+                  "p95 %.0f ms, kolejka %d",
+                  open, rate, REG_CLOSE_MAX_UTIL * 100, open - 1, p95_ms, queue_count);
+        closeWindow(open);
+        g_forecast.last_change_ns = monotonicNs();
+    }
+}
+
 static void* queueControllerThread(void*) {
-    logMessage(g_state, g_semid, "[RegCtrl] Kontroler rejestracji startuje (K_OPEN=%d, K_CLOSE=%d)",
-              K_OPEN, K_CLOSE);
+    if constexpr (REG_CTRL_MODE == REG_CTRL_PREDICTIVE) {
+        logMessage(g_state, g_semid,
+                  "[RegCtrl] Kontroler predykcyjny startuje (M=%d, cel p95=%d ms, min. czas zmiany=%d ms)",
+                  g_scenario.p.reg_windows, REG_WAIT_P95_TARGET_MS, REG_MIN_DWELL_MS);
+        g_forecast.last_sample_ns = g_forecast.last_change_ns = monotonicNs();
+    } else {
+        logMessage(g_state, g_semid, "[RegCtrl] Kontroler rejestracji startuje (M=%d, próg okienka 2: K_OPEN=%d, K_CLOSE=%d)",
+                  g_scenario.p.reg_windows, g_scenario.p.reg_open_at[1], g_scenario.p.reg_close_at[1]);
+    }
 
     while (!shouldStop()) {
-        // Blokujące czekanie na zmianę kolejki (zero CPU w idle)
-        semWait(g_semid, SEM_REG_QUEUE_CHANGED);
+        // Blokujące czekanie na zmianę kolejki (zero CPU w idle); tryb predykcyjny
+        // budzi się też co REG_CTRL_TICK_MS, by napływ był próbkowany bez zdarzeń
+        if constexpr (REG_CTRL_MODE == REG_CTRL_PREDICTIVE)
+            semWaitTimeout(g_semid, SEM_REG_QUEUE_CHANGED, (int)(REG_CTRL_TICK_MS / g_time_scale) + 1);
+        else
+            semWait(g_semid, SEM_REG_QUEUE_CHANGED);
         if (shouldStop()) break;
 
+        // Skasuj flagę przed odczytem — zmiany po tym miejscu wyślą nowe powiadomienie,
+        // więc jedno przebudzenie obsługuje całą serię zdarzeń
+        __atomic_store_n(&g_state->reg_change_pending, 0, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&g_state->reg_ctrl_wakeups, 1, __ATOMIC_RELAXED);
+
         semWait(g_semid, SEM_SHM_MUTEX);
         int queue_count = g_state->reg_queue_count;
-        bool window2_open = g_state->reg_window_2_open;
+        int open = g_state->reg_windows_open;
+        long long arrivals = g_state->reg_arrivals;
         semSignal(g_semid, SEM_SHM_MUTEX);
 
-        if (!window2_open && queue_count >= K_OPEN) {
-            // Otwórz okienko 2
-            semWait(g_semid, SEM_SHM_MUTEX);
-            g_state->reg_window_2_open = 1;
-            semSignal(g_semid, SEM_SHM_MUTEX);
-
-            logMessage(g_state, g_semid, "[RegCtrl] Otwieram okienko 2 (kolejka: %d >= %d)",
-                      queue_count, K_OPEN);
-
-            pthread_mutex_lock(&g_window2_mutex);
-            g_window2_should_run = true;
-            pthread_cond_signal(&g_window2_cond);
-            pthread_mutex_unlock(&g_window2_mutex);
-
-        } else if (window2_open && queue_count < K_CLOSE) {
-            // Zamknij okienko 2
-            semWait(g_semid, SEM_SHM_MUTEX);
-            g_state->reg_window_2_open = 0;
-            semSignal(g_semid, SEM_SHM_MUTEX);
-
-            logMessage(g_state, g_semid, "[RegCtrl] Zamykam okienko 2 (kolejka: %d < %d)",
-                      queue_count, K_CLOSE);
-
-            pthread_mutex_lock(&g_window2_mutex);
-            g_window2_should_run = false;
-            pthread_mutex_unlock(&g_window2_mutex);
-
-            // Powtarzaj SIGUSR1 aż wątek potwierdzi wyjście z pętli msgrcv
-            while (g_window2_active && !shouldStop()) {
-                pthread_kill(g_window2_thread, SIGUSR1);
-                usleep(50000);
-            }
-        }
+        if constexpr (REG_CTRL_MODE == REG_CTRL_PREDICTIVE)
+            predictiveControl(queue_count, open, arrivals);
+        else
+            thresholdControl(queue_count, open);
     }
     return nullptr;
 }
@@ -240,8 +433,9 @@ static void emergencyIPCCleanup() {
     removeQueue(getIPCKey(MSG_KEY_ID));
     removeQueue(getGateQueueKey());
     removeQueue(getOrderGateLogKey());
-    removeQueue(getOrderTriageKey());
+    removeQueue(getTriageQueueKey());
     removeQueue(getOrderExitKey());
+    removeQueue(getOrderBoardKey());
 
     for (int i = DOCTOR_KARDIOLOG; i <= DOCTOR_PEDIATRA; i++)
         removeQueue(getSpecialistQueueKey((DoctorType)i));
@@ -252,22 +446,31 @@ static void emergencyIPCCleanup() {
 // ============================================================================
 
 int main() {
+    initIPC();
+    setupSignals();
+
+    // Opóźnienie startowe po podłączeniu IPC — msleep skalowany przez time_scale
     if constexpr (STARTUP_DELAY_REJESTRACJA_MS > 0)
         msleep(STARTUP_DELAY_REJESTRACJA_MS);
 
-    initIPC();
-    setupSignals();
+    if (g_scenario.p.registry_enabled) {
+        if (registryOpen(g_registry, g_semid))
+            logMessage(g_state, g_semid, "[Rejestr] %s: %llu rekordów", REGISTRY_FILE,
+                      (unsigned long long)registryCount(g_registry));
+    }
 
     logMessage(g_state, g_semid, "Okienko rejestracji 1 rozpoczyna pracę");
+    setWindowOpen(1, true);
 
-    // Kontroler kolejki (decyduje o otwarciu/zamknięciu okienka 2)
+    // Kontroler kolejki (decyduje o otwarciu/zamknięciu okienek 2..M)
     pthread_t controller_thread;
     if (pthread_create(&controller_thread, nullptr, queueControllerThread, nullptr) != 0)
         SOR_FATAL("pthread_create kontroler kolejki");
 
-    // Okienko 2 (początkowo nieaktywne, czeka na sygnał od kontrolera)
-    if (pthread_create(&g_window2_thread, nullptr, windowThread, (void*)(intptr_t)2) != 0)
-        SOR_FATAL("pthread_create okienko 2");
+    // Okienka 2..M tworzy kontroler przy otwarciu
+
+    // Okienko 1 gotowe do obsługi — bariera startowa dyrektora
+    signalReady(g_semid);
 
     // Wątek główny = okienko 1
     while (!shouldStop()) {
@@ -286,17 +489,17 @@ int main() {
     // Zakończenie — obudź wątki pomocnicze
     g_shutdown = 1;
 
-    pthread_mutex_lock(&g_window2_mutex);
-    g_window2_should_run = false;
-    pthread_cond_signal(&g_window2_cond);
-    pthread_mutex_unlock(&g_window2_mutex);
-    pthread_kill(g_window2_thread, SIGUSR1);
-
     semSignal(g_semid, SEM_REG_QUEUE_CHANGED);
-
-    pthread_join(g_window2_thread, nullptr);
     pthread_join(controller_thread, nullptr);
 
+    // Zamknij czynne okienka (kontroler już nie działa) i domknij okresy otwarcia
+    for (int w = g_scenario.p.reg_windows; w >= 1; w--)
+        closeWindow(w);
+    logWindowStats();
+
+    g_state->registry.records = registryCount(g_registry);
+    registryClose(g_registry);
+
     logMessage(g_state, g_semid, "Rejestracja kończy pracę");
 
     emergencyIPCCleanup();
@@ -14,9 +14,11 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdint>
 #include <ctime>
 #include <cerrno>
 #include <cstdarg>
+#include <cmath>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/prctl.h>
@@ -41,6 +43,38 @@ constexpr int N = 3;                    // Pojemność poczekalni SOR
 constexpr int K_OPEN = 2;            // Próg otwarcia drugiego okienka
 constexpr int K_CLOSE = 1;           // Próg zamknięcia drugiego okienka
 
+// --- Pula okienek rejestracji: okienko 1 zawsze czynne, 2..M otwierane kolejno ---
+constexpr int REG_MAX_WINDOWS = 8;   // Rozmiar tablic w SharedState (górny limit M)
+constexpr int REG_WINDOW_COUNT = 2;  // M — liczba okienek (2 = wymaganie tematu)
+// Okienko i+1 otwiera się gdy kolejka >= REG_OPEN_AT[i], zamyka gdy < REG_CLOSE_AT[i]
+// (histereza: próg zamknięcia < próg otwarcia). Indeks 0 = okienko 1, nieużywany.
+constexpr int REG_OPEN_AT[REG_MAX_WINDOWS]  = { 0, K_OPEN,  4, 6, 8, 10, 12, 14 };
+constexpr int REG_CLOSE_AT[REG_MAX_WINDOWS] = { 0, K_CLOSE, 2, 3, 4,  5,  6,  7 };
+static_assert(REG_WINDOW_COUNT >= 1 && REG_WINDOW_COUNT <= REG_MAX_WINDOWS,
+              "REG_WINDOW_COUNT musi byc w zakresie 1..REG_MAX_WINDOWS");
+
+constexpr bool regThresholdsValid() {
+    for (int i = 1; i < REG_MAX_WINDOWS; i++) {
+        if (REG_CLOSE_AT[i] >= REG_OPEN_AT[i]) return false;         // Brak histerezy
+        if (i > 1 && REG_OPEN_AT[i] < REG_OPEN_AT[i - 1]) return false;  // Progi rosnące
+    }
+    return true;
+}
+static_assert(regThresholdsValid(), "Progi okienek: REG_CLOSE_AT < REG_OPEN_AT i rosnace REG_OPEN_AT");
+
+// --- Sterowanie liczbą okienek rejestracji ---
+enum RegControllerMode { REG_CTRL_THRESHOLD, REG_CTRL_PREDICTIVE };
+constexpr RegControllerMode REG_CTRL_MODE = REG_CTRL_THRESHOLD;
+// REG_CTRL_THRESHOLD  — progi REG_OPEN_AT/REG_CLOSE_AT na chwilowej długości kolejki
+// REG_CTRL_PREDICTIVE — EWMA napływu i czasu oczekiwania, prognoza wzrostu kolejki,
+//                       okienka dobierane pod cel p95 czasu oczekiwania na rejestrację
+constexpr int REG_WAIT_P95_TARGET_MS = 1200;   // Cel p95 oczekiwania w kolejce rejestracji
+constexpr int REG_MIN_DWELL_MS = 3000;         // Min czas od ostatniej zmiany do zamknięcia okienka
+constexpr int REG_CTRL_TICK_MS = 250;          // Okres próbkowania napływu (też bez zdarzeń kolejki)
+constexpr int REG_FORECAST_HORIZON_MS = 2000;  // Horyzont prognozy długości kolejki
+constexpr double REG_EWMA_ALPHA = 0.2;         // Waga nowej próbki w EWMA
+constexpr double REG_CLOSE_MAX_UTIL = 0.7;     // Zamknij gdy n-1 okienek byłoby obciążone < 70%
+
 // Klucze IPC - generowane na podstawie ścieżki i identyfikatorów
 constexpr int SHM_KEY_ID = 'S';          // Klucz pamięci dzielonej
 constexpr int SEM_KEY_ID = 'E';          // Klucz semaforów
@@ -48,14 +82,23 @@ constexpr int MSG_KEY_ID = 'M';          // Klucz kolejki komunikatów
 constexpr int MSG_GATE_KEY_ID = 'G';     // Klucz kolejki tokenów poczekalni (FIFO gate)
 constexpr int MSG_ORDER_GATE_LOG_KEY_ID = 'h';  // Kolejka FIFO kolejności logowania wejścia
 constexpr int MSG_ORDER_REG_KEY_ID = 'i';       // Kolejka FIFO kolejności rejestracji
-constexpr int MSG_ORDER_TRIAGE_KEY_ID = 'j';    // Kolejka FIFO kolejności triażu
+constexpr int MSG_TRIAGE_KEY_ID = 'j';          // Kolejka wejściowa triażu (mtype = bilet triażowy)
 constexpr int MSG_ORDER_EXIT_KEY_ID = 'k';      // Kolejka FIFO kolejności wyjścia
+constexpr int MSG_ORDER_BOARD_KEY_ID = 'l';     // Kolejka FIFO czekających na łóżko oddziału
 
 // Czasy operacji w milisekundach
 constexpr int PATIENT_GEN_MIN_MS = 300;   // Min czas między generowaniem pacjentów
 constexpr int PATIENT_GEN_MAX_MS = 300;   // Max czas między generowaniem pacjentów
 constexpr int REGISTRATION_MIN_MS = 400;  // Min czas rejestracji
 constexpr int REGISTRATION_MAX_MS = 400; // Max czas rejestracji
+
+// --- Rejestr pacjentów (sor_registry.hpp, scenariusz: registry_enabled) — trwały między uruchomieniami ---
+constexpr int REGISTRY_ENABLED = 0;            // 1 = plik rejestru (~96 MB rzadki) w katalogu bieżącym
+constexpr const char* REGISTRY_FILE = "sor_registry.dat";
+constexpr unsigned long long REGISTRY_CAPACITY = 1ULL << 22;  // Sloty (~3.1 mln rekordów przy 75%)
+constexpr int REGISTRY_POPULATION = 2000;      // Pula tożsamości losowanych przez generator
+constexpr int REGISTRATION_KNOWN_MIN_MS = 150; // Rejestracja pacjenta znanego z rejestru
+constexpr int REGISTRATION_KNOWN_MAX_MS = 150;
 constexpr int TRIAGE_MIN_MS = 0;        // Min czas triażu
 constexpr int TRIAGE_MAX_MS = 0;       // Max czas triażu
 constexpr int TREATMENT_MIN_MS = 0;    // Min czas leczenia u specjalisty
@@ -63,6 +106,10 @@ constexpr int TREATMENT_MAX_MS = 0;    // Max czas leczenia u specjalisty
 constexpr int DOCTOR_BREAK_MIN_MS = 0; // Min czas przerwy lekarza
 constexpr int DOCTOR_BREAK_MAX_MS = 0;// Max czas przerwy lekarza
 
+// Adaptacyjne czekanie pacjenta: krótki spin na handoff_seq przed blokującym msgrcv
+constexpr bool SPIN_WAIT_ENABLED = true;  // false = zawsze od razu blokujący msgrcv
+constexpr int SPIN_MAX_US = 50;           // Górny limit budżetu spinu [µs, zegar ścienny]
+
 // FIXED_PROCESS_COUNT — definiowany niżej (po DoctorType i DOCTOR_ENABLED)
 
 // ============================================================================
@@ -77,6 +124,14 @@ constexpr int TRIAGE_HOME_PM    = 0;    // ‰ odesłany do domu z triażu — 5
 static_assert(TRIAGE_RED_PM + TRIAGE_YELLOW_PM + TRIAGE_GREEN_PM + TRIAGE_HOME_PM == 1000,
               "Suma promili triazu musi wynosic 1000");
 
+// --- Model triażu (scenariusz: triage_mode) ---
+enum TriageMode { TRIAGE_RANDOM, TRIAGE_NEWS };
+constexpr TriageMode TRIAGE_MODE = TRIAGE_RANDOM;
+// TRIAGE_RANDOM — kolor losowany wprost z wag TRIAGE_*_PM
+// TRIAGE_NEWS   — wagi losują ukrytą ostrość, z niej parametry życiowe, a kolor i kierunek
+//                 daje punktacja NEWS2 (sor_triage.hpp); POZ punktuje czekających partiami
+constexpr int TRIAGE_BATCH_MAX = 8;     // Maks. pacjentów w partii punktacji NEWS2
+
 // --- Przypisanie specjalisty (dorośli): promile [suma MUSI = 1000] ---
 // Dzieci (<18 lat) ZAWSZE trafiają do pediatry, te ‰ dotyczą tylko dorosłych.
 // Ustaw 0 = żaden dorosły pacjent nie trafi do tego specjalisty.
@@ -101,6 +156,86 @@ constexpr bool DOCTOR_ENABLED[] = {
     true,   // [6] pediatra
 };
 
+// --- Obsada: liczba instancji lekarza danej specjalności (wspólna kolejka specjalisty) ---
+constexpr int DOCTOR_MAX_INSTANCES = 8;  // Rozmiar tablic w SharedState
+constexpr int DOCTOR_STAFF[] = {
+    1,      // [0] POZ (triaż) — instancje podejmują pacjentów kolejno wg biletu triażowego
+    1,      // [1] kardiolog
+    1,      // [2] neurolog
+    1,      // [3] okulista
+    1,      // [4] laryngolog
+    1,      // [5] chirurg — przy SPEC_CHIRURG_PM = 1000 wąskie gardło, zwiększ obsadę
+    1,      // [6] pediatra
+};
+
+// --- Autoskalowanie specjalistów przez dyrektora (scenariusz: autoscale_max_staff) ---
+// Obsada DOCTOR_STAFF to minimum; dyrektor dokłada instancje do AUTOSCALE_MAX_STAFF
+// przy rosnącej kolejce/czekaniu i wycofuje je po okresie bezczynności.
+constexpr int AUTOSCALE_MAX_STAFF = 0;         // 0 = obsada stała
+constexpr int AUTOSCALE_TICK_MS = 500;         // Okres próbkowania kolejek specjalistów
+constexpr int AUTOSCALE_UP_QUEUE = 3;          // Dodaj gdy kolejka >= 3 pacjentów na czynnego lekarza
+constexpr int AUTOSCALE_UP_WAIT_MS = 3000;     // ... albo średnie czekanie w okresie >= 3 s
+constexpr double AUTOSCALE_DOWN_UTIL = 0.5;    // Bezczynność: pusta kolejka i zajętość < 50%
+constexpr int AUTOSCALE_IDLE_MS = 5000;        // Tyle bezczynności przed wycofaniem instancji
+constexpr int AUTOSCALE_COOLDOWN_MS = 4000;    // Min odstęp między zmianami obsady specjalności
+static_assert(AUTOSCALE_MAX_STAFF >= 0 && AUTOSCALE_MAX_STAFF <= DOCTOR_MAX_INSTANCES,
+              "AUTOSCALE_MAX_STAFF musi byc w zakresie 0..DOCTOR_MAX_INSTANCES");
+
+// --- Planowanie przerw przez dyrektora (scenariusz: break_interval_ms, break_max_defer_ms) ---
+// Co BREAK_INTERVAL_MS każda instancja specjalisty dostaje SIGUSR1, ale najwyżej jedna naraz
+// w specjalności, nigdy ostatni dostępny lekarz przy czekającym czerwonym, a przy kolejce
+// > BREAK_BACKLOG_PER_DOCTOR na pozostających lekarzy przerwa czeka (do BREAK_MAX_DEFER_MS).
+constexpr int BREAK_INTERVAL_MS = 0;           // 0 = przerwy tylko z klawiatury (1-6)
+constexpr int BREAK_TICK_MS = 500;             // Okres sprawdzania planu przerw
+constexpr int BREAK_BACKLOG_PER_DOCTOR = 2;    // "Niska kolejka": <= 2 pacjentów na pozostającego
+constexpr int BREAK_MAX_DEFER_MS = 10000;      // Po takim opóźnieniu przerwa mimo kolejki
+
+// --- Kolejność obsługi u specjalisty (scenariusz: specialist_sched, deadline_*_ms) ---
+enum SpecialistSchedMode { SCHED_STRICT_PRIORITY, SCHED_EDF };
+constexpr SpecialistSchedMode SPECIALIST_SCHED = SCHED_STRICT_PRIORITY;
+// SCHED_STRICT_PRIORITY — mtype = kolor; czerwony zawsze przed żółtym przed zielonym
+//                         (pod stałym obciążeniem zielony może czekać bez końca)
+// SCHED_EDF             — mtype = termin (dołączenie + cel koloru); msgrcv bierze najwcześniejszy
+//                         termin, więc czekający zielony w końcu wyprzedza nowych czerwonych
+constexpr int DEADLINE_RED_MS = 1000;      // Cel maks. czekania na specjalistę — czerwony
+constexpr int DEADLINE_YELLOW_MS = 5000;   // żółty
+constexpr int DEADLINE_GREEN_MS = 20000;   // zielony
+
+// --- Wywłaszczanie leczenia przez czerwonego (scenariusz: preempt_red) ---
+// Gdy żadna instancja specjalisty nie jest wolna, POZ wysyła SIGRTMIN tej, która leczy
+// najniższy kolor; ta przerywa leczenie, obsługuje czerwonego i dokańcza resztę czasu
+constexpr int PREEMPT_RED = 0;             // 1 = włączone (tylko z SCHED_STRICT_PRIORITY)
+
+// --- Przejmowanie pacjentów innej specjalności (scenariusz: work_stealing, steal_mask_<lekarz>) ---
+// Wolny specjalista przy pustej własnej kolejce bierze czoło (kolor, potem czas czekania)
+// najdłuższej zgodnej kolejki; POZ budzi go SIGRTMIN+1, gdy docelowy specjalista jest zajęty.
+// Maska = bity indeksów DoctorType, z których kolejek lekarz może brać (dzieci tylko pediatra).
+constexpr int WORK_STEALING = 0;           // 1 = włączone
+constexpr int STEAL_RESCAN_MS = 50;        // Blokujące czekanie przerywane co tyle ms (ms ścienne):
+                                           // pobudka SIGRTMIN+1 tuż przed msgrcv nie ginie na zawsze
+constexpr int STEAL_ADULT_MASK = 0x3E;     // Bity [1]..[5]: kardiolog..chirurg
+constexpr int STEAL_MASK[] = {
+    0,                  // [0] POZ (triaż) — nie leczy
+    STEAL_ADULT_MASK,   // [1] kardiolog
+    STEAL_ADULT_MASK,   // [2] neurolog
+    STEAL_ADULT_MASK,   // [3] okulista
+    STEAL_ADULT_MASK,   // [4] laryngolog
+    STEAL_ADULT_MASK,   // [5] chirurg
+    0,                  // [6] pediatra
+};
+
+// --- Przeciążenie: limit kolejki specjalisty (scenariusz: overload_policy, backlog_limit) ---
+enum OverloadPolicy { OVERLOAD_NONE, OVERLOAD_DIVERT, OVERLOAD_SEND_HOME, OVERLOAD_BACKPRESSURE };
+constexpr OverloadPolicy OVERLOAD_POLICY = OVERLOAD_NONE;
+// OVERLOAD_NONE         — kolejki bez limitu (pełna kolejka blokuje msgsnd POZ i cały triaż)
+// OVERLOAD_DIVERT       — zielony do pełnej kolejki: z triażu do innej placówki (wynik 2)
+// OVERLOAD_SEND_HOME    — zielony do pełnej kolejki: z triażu do domu
+// OVERLOAD_BACKPRESSURE — pełna kolejka wstrzymuje przyjęcia generatora, nikt nie jest odsyłany
+//                         (wznowienie, gdy kolejka spadnie do połowy limitu)
+// Czerwony i żółty trafiają do specjalisty, chyba że kolejka jądra jest pełna (msg_qbytes) —
+// wtedy przy DIVERT/SEND_HOME inna placówka. Dyrektor obcina backlog_limit do pojemności kolejki.
+constexpr int BACKLOG_LIMIT = 10;          // Pacjentów w kolejce specjalności, od których działa polityka
+
 // --- Wynik leczenia u specjalisty: prawdopodobieństwa [suma MUSI = 1000] ---
 // Podajemy w PROMILACH (‰) żeby obsłużyć ułamki procentów (np. 14,5% = 145‰)
 constexpr int OUTCOME_HOME_PM   = 0;   // ‰ wypisany do domu (85.0%)
@@ -109,6 +244,33 @@ constexpr int OUTCOME_OTHER_PM  = 0;     // ‰ skierowany do innej placówki (0
 static_assert(OUTCOME_HOME_PM + OUTCOME_WARD_PM + OUTCOME_OTHER_PM == 1000,
               "Suma promili wynikow leczenia musi wynosic 1000");
 
+// --- Oddziały szpitalne (scenariusz: ward_beds_<lekarz>, ward_los_<lekarz>_ms, ward_initial_pct) ---
+// Wynik "oddział" zajmuje łóżko na oddziale specjalności kierującej (indeks = DoctorType).
+// Bez wolnego łóżka pacjent czeka w SOR (boarding) i nadal zajmuje miejsce w poczekalni.
+// Pobyt ~ Exp(WARD_LOS_MS) w czasie symulacji; terminy wypisu trzyma kopiec w SHM,
+// z którego dyrektor co WARD_TICK_MS zdejmuje wypisanych (O(log n) na przyjęcie/wypis).
+constexpr int WARD_BEDS[] = {
+    0,      // [0] POZ — brak oddziału
+    0,      // [1] kardiologia (0 = bez limitu: przyjęcie natychmiast, jak dotąd)
+    0,      // [2] neurologia
+    0,      // [3] okulistyka
+    0,      // [4] laryngologia
+    0,      // [5] chirurgia
+    0,      // [6] pediatria
+};
+constexpr int WARD_LOS_MS[] = {   // Średni pobyt na oddziale (czas symulacji)
+    0,
+    5 * 24 * 3600 * 1000,   // kardiologia — 5 dni
+    7 * 24 * 3600 * 1000,   // neurologia — 7 dni
+    2 * 24 * 3600 * 1000,   // okulistyka — 2 dni
+    3 * 24 * 3600 * 1000,   // laryngologia — 3 dni
+    5 * 24 * 3600 * 1000,   // chirurgia — 5 dni
+    3 * 24 * 3600 * 1000,   // pediatria — 3 dni
+};
+constexpr int WARD_INITIAL_PCT = 0;       // Zajęte łóżka na starcie symulacji [%]
+constexpr int WARD_MAX_BEDS = 8192;       // Suma łóżek wszystkich oddziałów (rozmiar kopca w SHM)
+constexpr int WARD_TICK_MS = 1000;        // Okres wypisów dyrektora (czas symulacji)
+
 // --- Tryb dzieci ---
 enum ChildrenMode { CHILDREN_NORMAL, CHILDREN_ONLY, NO_CHILDREN };
 constexpr ChildrenMode CHILDREN_MODE = NO_CHILDREN;
@@ -162,6 +324,32 @@ inline const char* getDoctorName(DoctorType type) {
 
 static_assert(sizeof(DOCTOR_ENABLED) / sizeof(DOCTOR_ENABLED[0]) == DOCTOR_COUNT,
               "Tablica DOCTOR_ENABLED musi mieć DOCTOR_COUNT elementów");
+static_assert(sizeof(DOCTOR_STAFF) / sizeof(DOCTOR_STAFF[0]) == DOCTOR_COUNT,
+              "Tablica DOCTOR_STAFF musi mieć DOCTOR_COUNT elementów");
+
+constexpr bool doctorStaffValid() {
+    for (int i = 0; i < DOCTOR_COUNT; i++)
+        if (DOCTOR_STAFF[i] < 1 || DOCTOR_STAFF[i] > DOCTOR_MAX_INSTANCES) return false;
+    return true;
+}
+static_assert(doctorStaffValid(), "DOCTOR_STAFF: 1..DOCTOR_MAX_INSTANCES");
+static_assert(sizeof(STEAL_MASK) / sizeof(STEAL_MASK[0]) == DOCTOR_COUNT,
+              "Tablica STEAL_MASK musi mieć DOCTOR_COUNT elementów");
+
+/// Maska kradzieży: bez POZ, bez bitów spoza DoctorType, dzieci (pediatra) tylko u pediatry
+constexpr bool stealMaskValid(int thief, int mask) {
+    if (mask & ~((1 << DOCTOR_COUNT) - 1)) return false;
+    if (mask & (1 << DOCTOR_POZ)) return false;
+    if (thief == DOCTOR_POZ && mask != 0) return false;
+    return thief == DOCTOR_PEDIATRA || !(mask & (1 << DOCTOR_PEDIATRA));
+}
+
+constexpr bool stealMasksValid() {
+    for (int i = 0; i < DOCTOR_COUNT; i++)
+        if (!stealMaskValid(i, STEAL_MASK[i])) return false;
+    return true;
+}
+static_assert(stealMasksValid(), "STEAL_MASK: tylko specjaliści, dzieci wyłącznie u pediatry");
 
 constexpr int countEnabledDoctors() {
     int c = 0;
@@ -171,9 +359,17 @@ constexpr int countEnabledDoctors() {
     return c;
 }
 
-// Stałe procesy: dyrektor + generator + rejestracja + włączeni lekarze
+constexpr int countDoctorProcesses() {
+    int c = 0;
+    for (int i = 0; i < DOCTOR_COUNT; i++) {
+        if (DOCTOR_ENABLED[i]) c += DOCTOR_STAFF[i];
+    }
+    return c;
+}
+
+// Stałe procesy: dyrektor + generator + rejestracja + instancje włączonych lekarzy
 constexpr int ENABLED_DOCTOR_COUNT = countEnabledDoctors();
-constexpr int FIXED_PROCESS_COUNT = 3 + ENABLED_DOCTOR_COUNT;
+constexpr int FIXED_PROCESS_COUNT = 3 + countDoctorProcesses();
 
 enum TriageColor {
     COLOR_NONE = 0,      // Brak przypisanego koloru
@@ -204,9 +400,24 @@ enum SemIndex {
     SEM_SHM_MUTEX,           // Mutex pamięci dzielonej
     SEM_LOG_MUTEX,           // Mutex logowania do pliku
     SEM_REG_QUEUE_CHANGED,   // Sygnał zmiany kolejki rejestracji (budzi kontroler)
+    SEM_READY,               // Bariera startowa: każda rola +1 gdy podłączona i obsługuje
+    SEM_REGISTRY,            // Mutex rejestru pacjentów (plik mapowany, sor_registry.hpp)
+    SEM_ADMISSION,           // Wolne miejsca na procesy pacjentów (-p): generator P, exitSOR V
+    SEM_OVERLOADED,          // Liczba przeciążonych kolejek (BACKPRESSURE): generator czeka na 0
+    SEM_WARD_KARDIOLOG,      // Wolne łóżka oddziałów (ward_beds_*): pacjent P, wypis dyrektora V
+    SEM_WARD_NEUROLOG,
+    SEM_WARD_OKULISTA,
+    SEM_WARD_LARYNGOLOG,
+    SEM_WARD_CHIRURG,
+    SEM_WARD_PEDIATRA,
     SEM_COUNT                // Liczba semaforów
 };
 
+/// DOCTOR_KARDIOLOG=1 → SEM_WARD_KARDIOLOG, itd.
+inline int getWardSemIndex(DoctorType type) {
+    return (type >= DOCTOR_KARDIOLOG && type <= DOCTOR_PEDIATRA) ? SEM_WARD_KARDIOLOG + (type - 1) : -1;
+}
+
 /// DOCTOR_KARDIOLOG=1 → SEM_SPECIALIST_KARDIOLOG=0, itd.
 inline int getSpecialistSemIndex(DoctorType type) {
     return (type >= DOCTOR_KARDIOLOG && type <= DOCTOR_PEDIATRA) ? (type - 1) : -1;
@@ -226,7 +437,6 @@ constexpr size_t GATE_TOKEN_SIZE = sizeof(GateToken) - sizeof(long);
 enum MessageType {
     MSG_PATIENT_TO_REGISTRATION_VIP = 1,  // VIP - niższy mtype = wyższy priorytet w msgrcv
     MSG_PATIENT_TO_REGISTRATION = 2,      // Pacjent zwykły
-    MSG_PATIENT_TO_TRIAGE = 3,            // Pacjent po rejestracji idzie na triaż
     MSG_REGISTRATION_RESPONSE = 10000,    // Odpowiedź rejestracji (bazowy + patient_id)
     MSG_TRIAGE_RESPONSE = 20000,          // Odpowiedź POZ (bazowy + patient_id) - kolor i specjalista
     MSG_SPECIALIST_RESPONSE = 30000,      // Odpowiedź specjalisty (bazowy + patient_id)
@@ -257,8 +467,276 @@ struct SORMessage {
     int outcome;             // Wynik: 0=do domu, 1=oddział, 2=inna placówka
     int triage_ticket;       // Bilet triażowy (przydzielony przez rejestrację)
     int exit_ticket;         // Bilet wyjściowy (przydzielony przez lekarza)
+    long long sent_ns;       // CLOCK_MONOTONIC nadania odpowiedzi (pomiar opóźnienia przekazania)
+    long long enqueued_ns;   // CLOCK_MONOTONIC dołączenia do kolejki rejestracji
+    unsigned long long identity; // Syntetyczna tożsamość (klucz rejestru, 0 = brak)
+    int prev_visits;         // Wcześniejsze wizyty wg rejestru (0 = nowy pacjent)
+    TriageColor prev_color;  // Kolor z poprzedniego triażu (COLOR_NONE = brak)
 };
 
+// ============================================================================
+// STATYSTYKI OPÓŹNIEŃ PRZEKAZANIA (HANDOFF)
+// ============================================================================
+
+/// Etapy odpowiedzi do pacjenta: od msgsnd roli do odebrania przez czekającego pacjenta
+enum HandoffStage {
+    HANDOFF_REGISTRATION = 0,  // rejestracja → pacjent
+    HANDOFF_TRIAGE,            // POZ → pacjent
+    HANDOFF_SPECIALIST,        // specjalista → pacjent
+    HANDOFF_COUNT
+};
+
+/// Miejsca czekania pacjenta — osobny budżet spinu dla każdego (różne rozkłady czasu)
+enum WaitSite {
+    WAIT_GATE = 0,        // Tokeny poczekalni (czekanie na miejsce — przy pełnej SOR długie)
+    WAIT_ORDER_LOG,       // Kolejka porządkująca logowania wejścia (tuż po bramce)
+    WAIT_EXIT,            // Kolejka FIFO wyjścia (na poprzedników w kolejności biletów)
+    WAIT_REGISTRATION,    // Odpowiedź rejestracji
+    WAIT_TRIAGE,          // Odpowiedź POZ
+    WAIT_SPECIALIST,      // Odpowiedź specjalisty
+    WAIT_SITE_COUNT
+};
+
+/// Strojenie spinu współdzielone przez wszystkich pacjentów (procesy są krótkotrwałe,
+/// więc historia czasów czekania musi żyć w pamięci dzielonej). Wyścigi są nieszkodliwe.
+struct SpinTuner {
+    long long ewma_wait_ns;   // Średnia krocząca czasu czekania (zegar ścienny)
+    long long spin_hits;      // Odpowiedź złapana w fazie spinu
+    long long blocks;         // Przejście do blokującego msgrcv
+};
+
+inline const char* getHandoffName(HandoffStage stage) {
+    static const char* names[] = { "rejestracja→pacjent", "POZ→pacjent", "specjalista→pacjent" };
+    return (stage >= 0 && stage < HANDOFF_COUNT) ? names[stage] : "nieznany";
+}
+
+/// Licznik opóźnień aktualizowany atomowo (bez SEM_SHM_MUTEX na gorącej ścieżce)
+struct LatencyStats {
+    long long count;
+    long long sum_ns;
+    long long max_ns;
+};
+
+/// Statystyki rejestru pacjentów (uzupełniane przez rejestrację)
+struct RegistryStats {
+    LatencyStats lookup;      // Czas wyszukiwania (z oczekiwaniem na SEM_REGISTRY)
+    long long hits;           // Pacjenci znalezieni w rejestrze
+    long long records;        // Rekordów w pliku przy zamknięciu rejestracji
+};
+
+/// Statystyki jednej instancji lekarza (raport obsady dyrektora)
+struct DoctorStats {
+    long long served;         // Obsłużeni pacjenci
+    long long busy_ns;        // Czas od podjęcia pacjenta do odpowiedzi
+    int breaks;               // Wyjścia na oddział (SIGUSR1)
+    int preemptions;          // Leczenia przerwane dla czerwonego (SIGRTMIN)
+    long long stolen;         // Pacjenci przejęci z kolejek innych specjalności
+    long long break_ns;       // Czas na oddziale (utracona zdolność obsługi)
+};
+
+/// Zajęte łóżko w kopcu terminów wypisu (SharedState::ward_heap)
+struct WardStay {
+    long long due_ns;         // Termin wypisu (CLOCK_MONOTONIC)
+    int dept;                 // Oddział (DoctorType specjalności kierującej)
+};
+
+/// Statystyki jednego okienka rejestracji (czasy w ns zegara ściennego)
+struct RegWindowStats {
+    int open;                 // Czy okienko jest teraz czynne
+    int open_events;          // Ile razy otwierane
+    long long served;         // Obsłużeni pacjenci
+    long long busy_ns;        // Czas obsługi pacjentów
+    long long open_ns;        // Łączny czas otwarcia (bez bieżącego okresu)
+    long long opened_at_ns;   // Początek bieżącego okresu otwarcia
+};
+
+// ============================================================================
+// SCENARIUSZ — PARAMETRY WCZYTYWANE W CZASIE DZIAŁANIA (-c)
+// ============================================================================
+// Domyślne wartości = stałe z panelu powyżej. Dyrektor wczytuje plik scenariusza,
+// buduje tablice aliasów i kopiuje całość do SharedState; role kopiują ją lokalnie
+// (initScenario) — po starcie tylko odczyt, bez współdzielonych linii cache.
+
+constexpr int ALIAS_MAX_CATEGORIES = 8;
+
+/**
+ * @brief Tablica aliasów Vose'a — losowanie kategorii w O(1) niezależnie od ich liczby
+ *
+ * Kolumna i (równomiernie) zwraca value[i] gdy los < threshold[i], inaczej value[alias[i]].
+ */
+struct AliasTable {
+    int n;
+    uint64_t threshold[ALIAS_MAX_CATEGORIES];  // Skala 2^32 (2^32 = zawsze własna kategoria)
+    uint8_t alias[ALIAS_MAX_CATEGORIES];
+    int value[ALIAS_MAX_CATEGORIES];
+};
+
+/// Parametry liczbowe scenariusza — tylko int, ustawiane przez tabelę kluczy (sor_scenario.hpp)
+struct ScenarioParams {
+    int waiting_capacity;                  // N
+    int reg_windows;                       // M (1..REG_MAX_WINDOWS)
+    int reg_open_at[REG_MAX_WINDOWS];      // [1] = K_OPEN
+    int reg_close_at[REG_MAX_WINDOWS];     // [1] = K_CLOSE
+
+    int gen_min_ms, gen_max_ms;
+    int registration_min_ms, registration_max_ms;
+    int registration_known_min_ms, registration_known_max_ms;
+    int triage_min_ms, triage_max_ms;
+    int treatment_min_ms, treatment_max_ms;
+    int break_min_ms, break_max_ms;
+
+    // Wagi kategorii — względne (suma nie musi wynosić 1000)
+    int triage_pm[4];                      // czerwony, żółty, zielony, do domu
+    int spec_pm[5];                        // kardiolog..chirurg (dorośli)
+    int outcome_pm[3];                     // dom, oddział, inna placówka
+    int doctor_enabled[DOCTOR_COUNT];
+    int doctor_staff[DOCTOR_COUNT];        // Instancje na specjalność (1..DOCTOR_MAX_INSTANCES)
+    int autoscale_max_staff;               // Górna granica autoskalowania specjalisty (0 = wyłączone)
+    int specialist_sched;                  // SpecialistSchedMode
+    int deadline_ms[COLOR_SENT_HOME];      // Cel czekania wg koloru (indeks = TriageColor)
+    int preempt_red;                       // 1 = czerwony przerywa leczenie niższego koloru
+    int work_stealing;                     // 1 = wolny specjalista przejmuje z innych kolejek
+    int steal_mask[DOCTOR_COUNT];          // Z których kolejek (bity DoctorType) może brać
+    int overload_policy;                   // OverloadPolicy
+    int backlog_limit;                     // Próg kolejki specjalności dla overload_policy
+    int break_interval_ms;                 // Plan przerw dyrektora (0 = tylko klawiatura)
+    int break_max_defer_ms;                // Maks. odroczenie przerwy z powodu kolejki
+    int triage_mode;                       // TriageMode
+    int registry_enabled;                  // 1 = rejestr pacjentów (REGISTRY_FILE)
+    int ward_beds[DOCTOR_COUNT];           // Łóżka oddziału (0 = bez limitu)
+    int ward_los_ms[DOCTOR_COUNT];         // Średni pobyt na oddziale
+    int ward_initial_pct;                  // Zajętość łóżek na starcie [%]
+};
+
+struct ScenarioConfig {
+    ScenarioParams p;
+    AliasTable triage;
+    AliasTable specialist;
+    AliasTable outcome;
+};
+
+/**
+ * @brief Buduje tablicę aliasów z wag (metoda Vose'a, O(n))
+ * @return false gdy suma wag <= 0 lub waga ujemna
+ */
+inline bool aliasBuild(AliasTable& t, const int* weights, const int* values, int n) {
+    long long total = 0;
+    for (int i = 0; i < n; i++) {
+        if (weights[i] < 0) return false;
+        total += weights[i];
+    }
+    if (total <= 0 || n > ALIAS_MAX_CATEGORIES) return false;
+
+    double scaled[ALIAS_MAX_CATEGORIES];
+    int small[ALIAS_MAX_CATEGORIES], large[ALIAS_MAX_CATEGORIES];
+    int ns = 0, nl = 0;
+    t.n = n;
+    for (int i = 0; i < n; i++) {
+        scaled[i] = (double)weights[i] * n / total;
+        t.value[i] = values[i];
+        t.alias[i] = (uint8_t)i;
+        (scaled[i] < 1.0 ? small[ns++] : large[nl++]) = i;
+    }
+    while (ns > 0 && nl > 0) {
+        int s = small[--ns], l = large[--nl];
+        t.threshold[s] = (uint64_t)(scaled[s] * 4294967296.0);
+        t.alias[s] = (uint8_t)l;
+        scaled[l] -= 1.0 - scaled[s];
+        (scaled[l] < 1.0 ? small[ns++] : large[nl++]) = l;
+    }
+    // Pozostałe kolumny są pełne (różnice tylko z zaokrągleń)
+    while (nl > 0) t.threshold[large[--nl]] = 1ULL << 32;
+    while (ns > 0) t.threshold[small[--ns]] = 1ULL << 32;
+    return true;
+}
+
+/// Przelicza tablice aliasów z wag w p (po wczytaniu scenariusza)
+inline bool scenarioBuildTables(ScenarioConfig& sc) {
+    static const int colors[] = { COLOR_RED, COLOR_YELLOW, COLOR_GREEN, COLOR_SENT_HOME };
+    static const int specialists[] = { DOCTOR_KARDIOLOG, DOCTOR_NEUROLOG, DOCTOR_OKULISTA,
+                                       DOCTOR_LARYNGOLOG, DOCTOR_CHIRURG };
+    static const int outcomes[] = { 0, 1, 2 };
+    return aliasBuild(sc.triage, sc.p.triage_pm, colors, 4)
+        && aliasBuild(sc.specialist, sc.p.spec_pm, specialists, 5)
+        && aliasBuild(sc.outcome, sc.p.outcome_pm, outcomes, 3);
+}
+
+/// Scenariusz ze stałych kompilacji
+inline ScenarioConfig defaultScenario() {
+    ScenarioConfig sc{};
+    ScenarioParams& p = sc.p;
+    p.waiting_capacity = N;
+    p.reg_windows = REG_WINDOW_COUNT;
+    for (int i = 0; i < REG_MAX_WINDOWS; i++) {
+        p.reg_open_at[i] = REG_OPEN_AT[i];
+        p.reg_close_at[i] = REG_CLOSE_AT[i];
+    }
+    p.gen_min_ms = PATIENT_GEN_MIN_MS;               p.gen_max_ms = PATIENT_GEN_MAX_MS;
+    p.registration_min_ms = REGISTRATION_MIN_MS;     p.registration_max_ms = REGISTRATION_MAX_MS;
+    p.registration_known_min_ms = REGISTRATION_KNOWN_MIN_MS;
+    p.registration_known_max_ms = REGISTRATION_KNOWN_MAX_MS;
+    p.triage_min_ms = TRIAGE_MIN_MS;                 p.triage_max_ms = TRIAGE_MAX_MS;
+    p.treatment_min_ms = TREATMENT_MIN_MS;           p.treatment_max_ms = TREATMENT_MAX_MS;
+    p.break_min_ms = DOCTOR_BREAK_MIN_MS;            p.break_max_ms = DOCTOR_BREAK_MAX_MS;
+    const int triage[] = { TRIAGE_RED_PM, TRIAGE_YELLOW_PM, TRIAGE_GREEN_PM, TRIAGE_HOME_PM };
+    const int spec[] = { SPEC_KARDIOLOG_PM, SPEC_NEUROLOG_PM, SPEC_OKULISTA_PM,
+                         SPEC_LARYNGOLOG_PM, SPEC_CHIRURG_PM };
+    const int outcome[] = { OUTCOME_HOME_PM, OUTCOME_WARD_PM, OUTCOME_OTHER_PM };
+    memcpy(p.triage_pm, triage, sizeof(triage));
+    memcpy(p.spec_pm, spec, sizeof(spec));
+    memcpy(p.outcome_pm, outcome, sizeof(outcome));
+    for (int i = 0; i < DOCTOR_COUNT; i++) {
+        p.doctor_enabled[i] = DOCTOR_ENABLED[i];
+        p.doctor_staff[i] = DOCTOR_STAFF[i];
+        p.steal_mask[i] = STEAL_MASK[i];
+        p.ward_beds[i] = WARD_BEDS[i];
+        p.ward_los_ms[i] = WARD_LOS_MS[i];
+    }
+    p.autoscale_max_staff = AUTOSCALE_MAX_STAFF;
+    p.specialist_sched = SPECIALIST_SCHED;
+    p.deadline_ms[COLOR_RED] = DEADLINE_RED_MS;
+    p.deadline_ms[COLOR_YELLOW] = DEADLINE_YELLOW_MS;
+    p.deadline_ms[COLOR_GREEN] = DEADLINE_GREEN_MS;
+    p.preempt_red = PREEMPT_RED;
+    p.work_stealing = WORK_STEALING;
+    p.overload_policy = OVERLOAD_POLICY;
+    p.backlog_limit = BACKLOG_LIMIT;
+    p.break_interval_ms = BREAK_INTERVAL_MS;
+    p.break_max_defer_ms = BREAK_MAX_DEFER_MS;
+    p.triage_mode = TRIAGE_MODE;
+    p.registry_enabled = REGISTRY_ENABLED;
+    p.ward_initial_pct = WARD_INITIAL_PCT;
+    scenarioBuildTables(sc);
+    return sc;
+}
+
+inline int enabledDoctorCount(const ScenarioParams& p) {
+    int c = 0;
+    for (int i = 0; i < DOCTOR_COUNT; i++) c += p.doctor_enabled[i] ? 1 : 0;
+    return c;
+}
+
+/// Procesy lekarzy: suma obsady włączonych specjalności
+inline int doctorProcessCount(const ScenarioParams& p) {
+    int c = 0;
+    for (int i = 0; i < DOCTOR_COUNT; i++) c += p.doctor_enabled[i] ? p.doctor_staff[i] : 0;
+    return c;
+}
+
+/// Górna granica obsady specjalności (obsada startowa albo limit autoskalowania)
+inline int maxDoctorStaff(const ScenarioParams& p, int type) {
+    if (type == DOCTOR_POZ || p.autoscale_max_staff < p.doctor_staff[type]) return p.doctor_staff[type];
+    return p.autoscale_max_staff;
+}
+
+/// Stałe procesy przy danym scenariuszu (odpowiednik FIXED_PROCESS_COUNT) — z zapasem
+/// na instancje dokładane przez autoskalowanie, żeby -p nie zostało przekroczone
+inline int fixedProcessCount(const ScenarioParams& p) {
+    int c = 3;
+    for (int i = 0; i < DOCTOR_COUNT; i++) c += p.doctor_enabled[i] ? maxDoctorStaff(p, i) : 0;
+    return c;
+}
+
 // ============================================================================
 // STRUKTURA PAMIĘCI DZIELONEJ
 // ============================================================================
@@ -267,9 +745,15 @@ struct SharedState {
     // Czas startu symulacji (do obliczania timestampów)
     time_t start_time_sec;
     long start_time_nsec;
+
+    // Współczynnik upływu czasu symulacji (-x): 10.0 = 10x szybciej niż zegar ścienny
+    double time_scale;
     
     // Flaga zakończenia symulacji
     volatile sig_atomic_t shutdown;
+
+    // Drenaż: generator nie przyjmuje nowych pacjentów, obecni kończą wizytę
+    volatile sig_atomic_t draining;
     
     // PID dyrektora (głównego procesu)
     pid_t director_pid;
@@ -277,19 +761,31 @@ struct SharedState {
     // PID procesu rejestracji
     pid_t registration_pid;
     
-    // PIDy lekarzy (do wysyłania sygnałów)
-    pid_t doctor_pids[DOCTOR_COUNT];
+    // PIDy lekarzy (do wysyłania sygnałów) — [typ][instancja], 0 = brak
+    pid_t doctor_pids[DOCTOR_COUNT][DOCTOR_MAX_INSTANCES];
+    DoctorStats doctor_stats[DOCTOR_COUNT][DOCTOR_MAX_INSTANCES];
+    LatencyStats specialist_wait[DOCTOR_COUNT];   // Od wysłania przez POZ do podjęcia przez specjalistę
+    LatencyStats color_wait[COLOR_SENT_HOME];     // To samo wg koloru (indeks = TriageColor)
+    LatencyStats break_wait[2];                   // [1] gdy ktoś ze specjalności był na przerwie
+    int red_queued[DOCTOR_COUNT];                 // Czerwoni w kolejce specjalisty (plan przerw)
+    long long deadline_miss[COLOR_SENT_HOME];     // Podjęci po terminie deadline_ms[kolor]
     
     // Stan okienek rejestracji
-    int reg_window_2_open;           // Czy okienko 2 jest otwarte
+    int reg_windows_open;            // Liczba czynnych okienek (1..REG_WINDOW_COUNT)
     int reg_queue_count;             // Liczba osób w kolejce do rejestracji
+    long long reg_arrivals;          // Licznik dołączeń do kolejki rejestracji (napływ)
+    int reg_change_pending;          // 1 = kontroler ma już zaległe powiadomienie
+    long long reg_ctrl_wakeups;      // Liczba przebudzeń kontrolera rejestracji
+    RegWindowStats reg_window[REG_MAX_WINDOWS];
+    RegistryStats registry;
     
     // Liczniki do statystyk
     int total_patients;              // Całkowita liczba wygenerowanych pacjentów
     int patients_in_sor;             // Osób aktualnie w budynku SOR (dziecko+opiekun = 2)
     
     // Stan lekarzy (czy są na oddziale)
-    volatile sig_atomic_t doctor_on_break[DOCTOR_COUNT];
+    volatile sig_atomic_t doctor_on_break[DOCTOR_COUNT][DOCTOR_MAX_INSTANCES];
+    int doctor_treating[DOCTOR_COUNT][DOCTOR_MAX_INSTANCES];  // Kolor leczonego (COLOR_NONE = wolny)
     
     // ID kolejek komunikatów specjalistów (indeks = DoctorType; slot [0]=POZ nieużywany=-1)
     int specialist_msgids[DOCTOR_COUNT];
@@ -303,19 +799,62 @@ struct SharedState {
     
     // Bilety porządkujące (FIFO triaż i wyjście)
     int triage_next_ticket;          // Następny bilet triażowy (przydzielany przez rejestrację)
+    long triage_dispatch_next;       // Następny bilet podejmowany przez wolnego POZ (fetch_add)
+    long long triage_batches;        // TRIAGE_NEWS: partie punktacji
+    long long triage_batched;        // ... pacjenci w nich
+    long long triage_score_ns;       // ... łączny czas jądra punktacji
+    long long triage_news_color[COLOR_SENT_HOME + 1];  // Kolory z NEWS2 (indeks = TriageColor)
+    int triage_msgid;                // Kolejka wejściowa triażu: mtype = bilet triażowy
     int exit_next_ticket;            // Następny bilet wyjściowy (przydzielany przez lekarza)
     
     // Kolejki FIFO porządkujące (blokujące zamiast busy-wait spin-loopów)
     int order_gate_log_msgid;        // Kolejka FIFO kolejności logowania wejścia
     int order_reg_msgid;             // Kolejka FIFO kolejności rejestracji
-    int order_triage_msgid;          // Kolejka FIFO kolejności triażu
     int order_exit_msgid;            // Kolejka FIFO kolejności wyjścia
+    int order_board_msgid;           // Kolejka FIFO boardingu (mtype = wardBoardMtype)
 
     // Limit jednoczesnych procesów (łącznie ze stałymi; 0 = bez limitu)
     int max_patients;
     
     // Licznik aktywnych PROCESÓW pacjentów (1 proces = 1, niezależnie od wątków/opiekunów)
     int active_patient_count;
+
+    // Opóźnienia przekazania odpowiedzi (porównanie rozmieszczenia na CPU, -a)
+    LatencyStats handoff[HANDOFF_COUNT];
+
+    unsigned long long run_seed;     // Ziarno strumieni losowych (-s); ustala decyzje per pacjent
+    ScenarioConfig scenario;         // Parametry scenariusza (-c), tylko odczyt po starcie
+
+    // Przepustowość i czas pobytu (wyszukiwanie punktu nasycenia, -S)
+    double gen_rate;                 // >0: generator losuje odstępy Exp(gen_rate) [pacjentów/s]
+    long long completed_patients;    // Pacjenci, którzy przeszli całą ścieżkę i wyszli
+    LatencyStats sojourn;            // Czas od startu procesu pacjenta do wyjścia z SOR
+    LatencyStats stage_time[HANDOFF_COUNT];  // Etap zakończony odpowiedzią (z czekaniem w kolejce)
+
+    // Kontrola przyjęć w generatorze (-p, -b)
+    double admit_rate;               // >0: wiadro żetonów [pacjentów/s symulacji]
+    int admit_burst;                 // Pojemność wiadra (maks. przyjęć naraz)
+    LatencyStats admission_wait;     // Czekanie generatora na miejsce/żeton przed przyjęciem
+    LatencyStats backpressure_wait;  // Wstrzymania przyjęć przez przeciążone kolejki (BACKPRESSURE)
+    int backlog_over[DOCTOR_COUNT];  // Kolejka specjalności ponad backlog_limit (BACKPRESSURE)
+    long long shed[DOCTOR_COUNT];    // Zieloni odesłani z triażu przy pełnej kolejce (DIVERT/HOME)
+
+    // Oddziały szpitalne (ward_beds_*; indeks = DoctorType, zmiany pod SEM_SHM_MUTEX)
+    WardStay ward_heap[WARD_MAX_BEDS];        // Kopiec min. terminów wypisu zajętych łóżek
+    int ward_heap_size;
+    int ward_occupied[DOCTOR_COUNT];          // Zajęte łóżka
+    int ward_peak[DOCTOR_COUNT];              // ... maksimum
+    int ward_boarding[DOCTOR_COUNT];          // Czekający w SOR na łóżko
+    int ward_boarding_peak[DOCTOR_COUNT];     // ... maksimum
+    int ward_board_next_ticket[DOCTOR_COUNT]; // Następny bilet boardingu oddziału (od 1)
+    long long ward_admitted[DOCTOR_COUNT];    // Przyjęci z SOR
+    long long ward_discharged[DOCTOR_COUNT];  // Wypisani (także zajmujący łóżko od startu)
+    long long ward_bed_ns[DOCTOR_COUNT];      // Całka zajętości [łóżko × ns] — liczy dyrektor
+    LatencyStats ward_boarding_wait[DOCTOR_COUNT];  // Od wyniku leczenia do łóżka
+
+    // Licznik nadań do czekających pacjentów — obserwowany w fazie spinu zamiast syscalla
+    unsigned int handoff_seq;
+    SpinTuner spin[WAIT_SITE_COUNT];
     
     // Ścieżka do pliku logu
     char log_file[256];
@@ -415,21 +954,77 @@ inline void semSignal(int semid, int sem_num) {
     }
 }
 
+/// Operacja P z limitem czasu (ms zegara ściennego) — false gdy upłynął lub IPC usunięte
+inline bool semWaitTimeout(int semid, int sem_num, int timeout_ms) {
+    struct sembuf op{};
+    op.sem_num = sem_num;
+    op.sem_op = -1;
+    op.sem_flg = 0;
+    struct timespec ts{ timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+
+    while (semtimedop(semid, &op, 1, &ts) == -1) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EIDRM && errno != EINVAL)
+            SOR_WARN("semWaitTimeout sem_num=%d", sem_num);
+        return false;
+    }
+    return true;
+}
+
+/// Powiadamia kontroler rejestracji o zmianie kolejki. Semafor podnosi tylko
+/// przejście flagi 0→1 — seria zmian przed odczytem przez kontroler to jedno przebudzenie.
+inline void notifyRegQueueChanged(SharedState* state, int semid) {
+    if (__atomic_exchange_n(&state->reg_change_pending, 1, __ATOMIC_SEQ_CST) == 0)
+        semSignal(semid, SEM_REG_QUEUE_CHANGED);
+}
+
+/// Zgłasza dyrektorowi gotowość roli (bariera startowa przed uruchomieniem generatora)
+inline void signalReady(int semid) {
+    semSignal(semid, SEM_READY);
+}
+
 inline int semGetValue(int semid, int sem_num) {
     return semctl(semid, sem_num, GETVAL);
 }
 
+// ============================================================================
+// FUNKCJE POMOCNICZE - POMIAR CZASU
+// ============================================================================
+
+/// Zegar ścienny CLOCK_MONOTONIC w nanosekundach (niezależny od time_scale)
+inline long long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/// Dopisuje pomiar do statystyki w pamięci dzielonej (atomowo, bez mutexu)
+inline void recordLatency(LatencyStats& st, long long ns) {
+    if (ns < 0) ns = 0;
+    __atomic_fetch_add(&st.count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st.sum_ns, ns, __ATOMIC_RELAXED);
+    long long cur = __atomic_load_n(&st.max_ns, __ATOMIC_RELAXED);
+    while (ns > cur && !__atomic_compare_exchange_n(&st.max_ns, &cur, ns, true,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+/// Sygnalizuje spinującym pacjentom, że w którejś kolejce pojawił się komunikat
+inline void bumpHandoffSeq(SharedState* state) {
+    __atomic_add_fetch(&state->handoff_seq, 1, __ATOMIC_RELEASE);
+}
+
 // ============================================================================
 // FUNKCJE POMOCNICZE - LOGOWANIE
 // ============================================================================
 
+/// Czas symulacji w sekundach (czas ścienny od startu × time_scale)
 inline double getElapsedTime(SharedState* state) {
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
     
     double elapsed = (now.tv_sec - state->start_time_sec) + 
                      (now.tv_nsec - state->start_time_nsec) / 1e9;
-    return elapsed;
+    return (state->time_scale > 0.0) ? elapsed * state->time_scale : elapsed;
 }
 
 /// Loguje [XXX.XXs] msg do pliku + stdout. Lazy-open per proces (write — wymaganie 5.2a).
@@ -476,17 +1071,132 @@ inline void logMessage(SharedState* state, int semid, const char* format, ...) {
 // FUNKCJE POMOCNICZE - LOSOWOŚĆ
 // ============================================================================
 
+// Strumienie Philox4x32-10 (generator licznikowy): klucz = ziarno przebiegu (-s),
+// licznik = (rola, identyfikator, numer bloku). Strumień ma 32 B stanu i nie wymaga
+// rozgrzewania — tworzenie go per pacjent jest tańsze niż jedno std::random_device.
+
+/// Rola strumienia — ta sama decyzja w dwóch przebiegach z tym samym ziarnem
+/// pochodzi z tego samego strumienia niezależnie od przeplotu procesów
+enum RngRole : uint32_t {
+    RNG_ROLE_THREAD = 0,        // Domyślny strumień wątku (pid, tid) — bez gwarancji powtarzalności
+    RNG_ROLE_ARRIVALS,          // Odstępy między przyjęciami (generator, sekwencyjnie)
+    RNG_ROLE_PATIENT,           // Atrybuty pacjenta: wiek, VIP, tożsamość
+    RNG_ROLE_REGISTRATION,      // Czas rejestracji
+    RNG_ROLE_TRIAGE,            // Kolor, specjalista, czas triażu
+    RNG_ROLE_TREATMENT,         // Czas leczenia, wynik
+    RNG_ROLE_WARD,              // Czas pobytu na oddziale (id 0 = łóżka zajęte na starcie)
+};
+
+struct PhiloxStream {
+    uint32_t key[2];
+    uint32_t ctr[4];     // [0..1] numer bloku, [2] rola, [3] identyfikator
+    uint32_t out[4];
+    int used;            // Zużyte słowa z out (4 = wygeneruj nowy blok)
+};
+
+inline void philoxBlock(PhiloxStream& s) {
+    uint32_t c0 = s.ctr[0], c1 = s.ctr[1], c2 = s.ctr[2], c3 = s.ctr[3];
+    uint32_t k0 = s.key[0], k1 = s.key[1];
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * c2;
+        uint32_t n0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0; c1 = (uint32_t)p1; c2 = n2; c3 = (uint32_t)p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    s.out[0] = c0; s.out[1] = c1; s.out[2] = c2; s.out[3] = c3;
+    s.used = 0;
+    if (++s.ctr[0] == 0) ++s.ctr[1];
+}
+
+inline PhiloxStream makeRngStream(uint64_t seed, uint32_t role, uint32_t id) {
+    PhiloxStream s{};
+    s.key[0] = (uint32_t)seed;
+    s.key[1] = (uint32_t)(seed >> 32);
+    s.ctr[2] = role;
+    s.ctr[3] = id;
+    s.used = 4;
+    return s;
+}
+
+inline uint32_t rngNext32(PhiloxStream& s) {
+    if (s.used == 4) philoxBlock(s);
+    return s.out[s.used++];
+}
+
+/// Ziarno przebiegu — kopia SharedState::run_seed, ustawiana przez initRandom()
+inline uint64_t g_run_seed = 0;
+
+/// Bieżący strumień wątku; RngScope podmienia go na strumień konkretnej decyzji
+inline PhiloxStream& threadRng() {
+    static thread_local bool ready = false;
+    static thread_local PhiloxStream s;
+    if (!ready) {
+        uint64_t seed = g_run_seed ? g_run_seed : (uint64_t)std::random_device{}() << 32 | std::random_device{}();
+        s = makeRngStream(seed ^ ((uint64_t)getpid() << 32), RNG_ROLE_THREAD, (uint32_t)gettid());
+        ready = true;
+    }
+    return s;
+}
+
+/**
+ * @brief Na czas życia obiektu losowania wątku idą ze strumienia (rola, id)
+ *
+ * Np. RngScope rng(RNG_ROLE_TRIAGE, patient_id) — kolor i specjalista pacjenta
+ * zależą tylko od ziarna i jego id, nie od kolejności obsługi.
+ */
+struct RngScope {
+    PhiloxStream saved;
+    RngScope(RngRole role, uint32_t id) : saved(threadRng()) {
+        threadRng() = makeRngStream(g_run_seed, role, id);
+    }
+    ~RngScope() { threadRng() = saved; }
+    RngScope(const RngScope&) = delete;
+    RngScope& operator=(const RngScope&) = delete;
+};
+
+/// Liczba całkowita z [min, max] (mnożenie 32×32→64 zamiast dzielenia modulo)
 inline int randomInt(int min, int max) {
-    static thread_local std::mt19937 gen(std::random_device{}());
-    std::uniform_int_distribution<> dis(min, max);
-    return dis(gen);
+    uint64_t range = (uint64_t)((int64_t)max - min) + 1;
+    return min + (int)((rngNext32(threadRng()) * range) >> 32);
+}
+
+/// Liczba losowa z przedziału (0, 1] — bezpieczna jako argument log()
+inline double randomUniform() {
+    PhiloxStream& s = threadRng();
+    uint64_t bits = ((uint64_t)rngNext32(s) << 21) ^ (rngNext32(s) >> 11);  // 53 bity
+    return (bits + 1) * (1.0 / 9007199254740992.0);
+}
+
+/// Lokalna (per proces) kopia SharedState::time_scale — ustawiana przez initSimClock()
+inline double g_time_scale = 1.0;
+
+/// Wczytuje ziarno przebiegu z pamięci dzielonej (wywołać po shmat, przed losowaniem)
+inline void initRandom(SharedState* state) {
+    if (state) g_run_seed = state->run_seed;
+}
+
+/// Lokalna kopia scenariusza — dyrektor wypełnia ją z -c przed initIPC, role z SharedState
+inline ScenarioConfig g_scenario = defaultScenario();
+
+inline void initScenario(SharedState* state) {
+    if (state) g_scenario = state->scenario;
+}
+
+/// Wczytuje współczynnik czasu z pamięci dzielonej (wywołać po shmat)
+inline void initSimClock(SharedState* state) {
+    if (state && state->time_scale > 0.0) g_time_scale = state->time_scale;
 }
 
-/// Usypia na ms milisekund (nanosleep + EINTR restart)
+/// Usypia na ms milisekund CZASU SYMULACJI (nanosleep + EINTR restart)
 inline void msleep(int ms) {
+    if (ms <= 0) return;
+    long long ns = (long long)(ms * 1000000.0 / g_time_scale);
     struct timespec req;
-    req.tv_sec  = ms / 1000;
-    req.tv_nsec = (ms % 1000) * 1000000L;
+    req.tv_sec  = ns / 1000000000LL;
+    req.tv_nsec = ns % 1000000000LL;
     while (nanosleep(&req, &req) == -1 && errno == EINTR) {
         // nanosleep zapisuje pozostały czas w req — kontynuuj sen
     }
@@ -496,39 +1206,29 @@ inline void randomSleep(int minMs, int maxMs) {
     msleep(randomInt(minMs, maxMs));
 }
 
-/// Losuje kolor triażu wg TRIAGE_*_PM
+/// Losowanie z tablicy aliasów: dwa słowa 32-bit — kolumna i rzut monetą
+inline int aliasSample(const AliasTable& t) {
+    PhiloxStream& s = threadRng();
+    uint32_t column = (uint32_t)(((uint64_t)rngNext32(s) * (uint32_t)t.n) >> 32);
+    return rngNext32(s) < t.threshold[column] ? t.value[column] : t.value[t.alias[column]];
+}
+
+/// Losuje kolor triażu wg wag scenariusza (domyślnie TRIAGE_*_PM)
 inline TriageColor randomTriageColor() {
-    int r = randomInt(1, 1000);
-    if (r <= TRIAGE_RED_PM) return COLOR_RED;
-    if (r <= TRIAGE_RED_PM + TRIAGE_YELLOW_PM) return COLOR_YELLOW;
-    if (r <= TRIAGE_RED_PM + TRIAGE_YELLOW_PM + TRIAGE_GREEN_PM) return COLOR_GREEN;
-    return COLOR_SENT_HOME;
+    return (TriageColor)aliasSample(g_scenario.triage);
 }
 
-/// Losuje specjalistę (dzieci → pediatra, dorośli → wg SPEC_*_PM)
+/// Losuje specjalistę (dzieci → pediatra, dorośli → wg wag scenariusza, domyślnie SPEC_*_PM)
 inline DoctorType randomSpecialist(int age) {
     if (age < 18) {
         return DOCTOR_PEDIATRA;
     }
-    int r = randomInt(1, 1000);
-    int cumulative = 0;
-    cumulative += SPEC_KARDIOLOG_PM;
-    if (r <= cumulative) return DOCTOR_KARDIOLOG;
-    cumulative += SPEC_NEUROLOG_PM;
-    if (r <= cumulative) return DOCTOR_NEUROLOG;
-    cumulative += SPEC_OKULISTA_PM;
-    if (r <= cumulative) return DOCTOR_OKULISTA;
-    cumulative += SPEC_LARYNGOLOG_PM;
-    if (r <= cumulative) return DOCTOR_LARYNGOLOG;
-    return DOCTOR_CHIRURG;
-}
-
-/// Losuje wynik leczenia wg OUTCOME_*_PM
+    return (DoctorType)aliasSample(g_scenario.specialist);
+}
+
+/// Losuje wynik leczenia: 0=do domu, 1=oddział, 2=inna placówka (domyślnie OUTCOME_*_PM)
 inline int randomOutcome() {
-    int r = randomInt(1, 1000);
-    if (r <= OUTCOME_HOME_PM) return 0;                            // do domu
-    if (r <= OUTCOME_HOME_PM + OUTCOME_WARD_PM) return 1;         // oddział
-    return 2;                                                       // inna placówka
+    return aliasSample(g_scenario.outcome);
 }
 
 /// Losuje wiek wg CHILDREN_MODE
@@ -575,8 +1275,9 @@ inline key_t getGateQueueKey() {
 
 inline key_t getOrderGateLogKey() { return getIPCKey(MSG_ORDER_GATE_LOG_KEY_ID); }
 inline key_t getOrderRegKey()     { return getIPCKey(MSG_ORDER_REG_KEY_ID); }
-inline key_t getOrderTriageKey()  { return getIPCKey(MSG_ORDER_TRIAGE_KEY_ID); }
+inline key_t getTriageQueueKey()  { return getIPCKey(MSG_TRIAGE_KEY_ID); }
 inline key_t getOrderExitKey()    { return getIPCKey(MSG_ORDER_EXIT_KEY_ID); }
+inline key_t getOrderBoardKey()   { return getIPCKey(MSG_ORDER_BOARD_KEY_ID); }
 
 /// Klucz IPC kolejki specjalisty: 'a' + (doctor_type - 1)
 inline key_t getSpecialistQueueKey(DoctorType doctor) {
@@ -0,0 +1,199 @@
+/**
+ * @file sor_registry.hpp
+ * @brief Trwały rejestr pacjentów — indeks haszujący w pliku mapowanym (mmap)
+ *
+ * Plik sor_registry.dat przeżywa kolejne uruchomienia symulacji:
+ * - nagłówek + tablica REGISTRY_CAPACITY slotów (adresowanie otwarte, sondowanie liniowe)
+ * - klucz = syntetyczna tożsamość pacjenta nadana przez generator (0 = slot pusty)
+ * - plik rzadki (ftruncate) — niezajęte strony nie zajmują miejsca na dysku
+ *
+ * Wyszukiwanie i zapis pod semaforem SEM_REGISTRY (rejestracja i POZ w różnych procesach).
+ * Usunięcie pliku = pusty rejestr przy następnym starcie.
+ */
+
+#ifndef SOR_REGISTRY_HPP
+#define SOR_REGISTRY_HPP
+
+#include "sor_common.hpp"
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ============================================================================
+// FORMAT PLIKU
+// ============================================================================
+
+constexpr uint32_t REGISTRY_MAGIC = 0x534f5252;   // "SORR"
+constexpr uint32_t REGISTRY_VERSION = 1;
+
+/// Rekord pacjenta — 24 bajty, bez wskaźników (plik przenośny między uruchomieniami)
+struct RegistryRecord {
+    uint64_t identity;       // Syntetyczna tożsamość (0 = slot pusty)
+    int32_t visits;          // Liczba wcześniejszych rejestracji
+    int32_t last_color;      // Kolor z ostatniego triażu (TriageColor, 0 = brak)
+    int32_t last_doctor;     // Ostatni przypisany lekarz (DoctorType)
+    int32_t reserved;
+};
+
+struct RegistryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;       // Liczba slotów (potęga 2)
+    uint64_t count;          // Zajęte sloty
+    uint64_t full_warned;    // Ostrzeżenie o zapełnieniu już zalogowane
+};
+
+struct Registry {
+    RegistryHeader* header = nullptr;
+    RegistryRecord* slots = nullptr;
+    size_t map_size = 0;
+    int semid = -1;
+};
+
+static_assert((REGISTRY_CAPACITY & (REGISTRY_CAPACITY - 1)) == 0,
+              "REGISTRY_CAPACITY musi byc potega 2");
+
+// ============================================================================
+// OTWARCIE / ZAMKNIĘCIE
+// ============================================================================
+
+/**
+ * @brief Mapuje plik rejestru (tworzy go przy pierwszym użyciu)
+ * @return false gdy plik nie daje się otworzyć/zmapować lub ma inny format — rejestr wyłączony
+ */
+inline bool registryOpen(Registry& reg, int semid) {
+    reg.semid = semid;
+    reg.map_size = sizeof(RegistryHeader) + (size_t)REGISTRY_CAPACITY * sizeof(RegistryRecord);
+
+    semWait(semid, SEM_REGISTRY);
+    int fd = open(REGISTRY_FILE, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        semSignal(semid, SEM_REGISTRY);
+        SOR_WARN("rejestr: open %s", REGISTRY_FILE);
+        return false;
+    }
+
+    struct stat st{};
+    bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (fresh && ftruncate(fd, reg.map_size) == -1) {
+        close(fd);
+        semSignal(semid, SEM_REGISTRY);
+        SOR_WARN("rejestr: ftruncate %s", REGISTRY_FILE);
+        return false;
+    }
+    if (!fresh && (size_t)st.st_size != reg.map_size) {
+        close(fd);
+        semSignal(semid, SEM_REGISTRY);
+        fprintf(stderr, "[Rejestr] %s ma inny rozmiar niż REGISTRY_CAPACITY — rejestr wyłączony\n",
+                REGISTRY_FILE);
+        return false;
+    }
+
+    void* base = mmap(nullptr, reg.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        semSignal(semid, SEM_REGISTRY);
+        SOR_WARN("rejestr: mmap %s", REGISTRY_FILE);
+        return false;
+    }
+
+    reg.header = (RegistryHeader*)base;
+    reg.slots = (RegistryRecord*)((char*)base + sizeof(RegistryHeader));
+    if (reg.header->magic == 0) {
+        reg.header->magic = REGISTRY_MAGIC;
+        reg.header->version = REGISTRY_VERSION;
+        reg.header->capacity = REGISTRY_CAPACITY;
+    }
+    bool valid = reg.header->magic == REGISTRY_MAGIC && reg.header->version == REGISTRY_VERSION;
+    semSignal(semid, SEM_REGISTRY);
+
+    if (!valid) {
+        munmap(base, reg.map_size);
+        reg.header = nullptr;
+        reg.slots = nullptr;
+        fprintf(stderr, "[Rejestr] %s ma nieznany format — rejestr wyłączony\n", REGISTRY_FILE);
+        return false;
+    }
+    return true;
+}
+
+inline void registryClose(Registry& reg) {
+    if (!reg.header) return;
+    munmap(reg.header, reg.map_size);
+    reg.header = nullptr;
+    reg.slots = nullptr;
+}
+
+// ============================================================================
+// INDEKS
+// ============================================================================
+
+/// Mieszanie splitmix64 — kolejne tożsamości trafiają w odległe sloty
+inline uint64_t registryHash(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Szuka slotu tożsamości (wołać pod SEM_REGISTRY)
+ * @return slot z tą tożsamością, pierwszy pusty slot na ścieżce sondowania,
+ *         albo nullptr gdy tablica pełna
+ */
+inline RegistryRecord* registryProbe(Registry& reg, uint64_t identity) {
+    const uint64_t mask = REGISTRY_CAPACITY - 1;
+    uint64_t i = registryHash(identity) & mask;
+    for (uint64_t n = 0; n < REGISTRY_CAPACITY; n++, i = (i + 1) & mask) {
+        RegistryRecord* r = &reg.slots[i];
+        if (r->identity == identity || r->identity == 0) return r;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Rejestruje wizytę: zwraca historię sprzed wizyty i zwiększa licznik wizyt
+ * @return true gdy pacjent był już w rejestrze (history wypełnione)
+ */
+inline bool registryVisit(Registry& reg, uint64_t identity, RegistryRecord* history) {
+    if (!reg.header || identity == 0) return false;
+
+    semWait(reg.semid, SEM_REGISTRY);
+    RegistryRecord* r = registryProbe(reg, identity);
+    bool known = r && r->identity == identity;
+    if (known) {
+        *history = *r;
+        r->visits++;
+    } else if (r && reg.header->count < REGISTRY_CAPACITY / 4 * 3) {
+        // Wypełnienie ograniczone do 75% — dłuższe sondowania spowolniłyby okienko
+        *r = RegistryRecord{};
+        r->identity = identity;
+        r->visits = 1;
+        reg.header->count++;
+    } else if (!reg.header->full_warned) {
+        reg.header->full_warned = 1;
+        fprintf(stderr, "[Rejestr] Rejestr zapełniony (%llu rekordów) — nowi pacjenci nie są zapisywani\n",
+                (unsigned long long)reg.header->count);
+    }
+    semSignal(reg.semid, SEM_REGISTRY);
+    return known;
+}
+
+/// Zapisuje wynik triażu do rekordu pacjenta (POZ)
+inline void registryRecordTriage(Registry& reg, uint64_t identity, TriageColor color, DoctorType doctor) {
+    if (!reg.header || identity == 0) return;
+
+    semWait(reg.semid, SEM_REGISTRY);
+    RegistryRecord* r = registryProbe(reg, identity);
+    if (r && r->identity == identity) {
+        r->last_color = color;
+        r->last_doctor = doctor;
+    }
+    semSignal(reg.semid, SEM_REGISTRY);
+}
+
+inline uint64_t registryCount(const Registry& reg) {
+    return reg.header ? reg.header->count : 0;
+}
+
+#endif // SOR_REGISTRY_HPP
@@ -0,0 +1,269 @@
+/**
+ * @file sor_scenario.hpp
+ * @brief Wczytywanie pliku scenariusza (-c) — parametry bez przebudowy binarek
+ *
+ * Format: linie "klucz = wartość", '#' = komentarz do końca linii. Klucze to nazwy stałych
+ * z sor_common.hpp małymi literami (np. triage_red_pm, treatment_max_ms, n, k_open,
+ * doctor_staff_chirurg); pominięte klucze zachowują wartość domyślną. Wagi *_pm są
+ * względne — suma nie musi wynosić 1000. Plik czyta tylko dyrektor; role dostają gotowy ScenarioConfig w SharedState.
+ */
+
+#ifndef SOR_SCENARIO_HPP
+#define SOR_SCENARIO_HPP
+
+#include "sor_common.hpp"
+#include <cstddef>
+
+// ============================================================================
+// TABELA KLUCZY
+// ============================================================================
+
+struct ScenarioKey {
+    const char* name;
+    size_t offset;       // offsetof(ScenarioParams, ...)
+    int min, max;
+};
+
+#define SCENARIO_KEY(name, field, min, max) { name, offsetof(ScenarioParams, field), min, max }
+
+constexpr int SCENARIO_MAX_MS = 3600 * 1000;
+constexpr int SCENARIO_MAX_LOS_MS = 20 * 24 * 3600 * 1000;   // Pobyt na oddziale do 20 dni
+
+inline const ScenarioKey SCENARIO_KEYS[] = {
+    SCENARIO_KEY("n",                         waiting_capacity,          1, 10000),
+    SCENARIO_KEY("reg_window_count",          reg_windows,               1, REG_MAX_WINDOWS),
+    SCENARIO_KEY("k_open",                    reg_open_at[1],            1, 100000),
+    SCENARIO_KEY("k_close",                   reg_close_at[1],           0, 100000),
+    // Progi okienek 3..M (REG_OPEN_AT/REG_CLOSE_AT), sufiks = numer okienka
+    SCENARIO_KEY("reg_open_at_3",             reg_open_at[2],            1, 100000),
+    SCENARIO_KEY("reg_close_at_3",            reg_close_at[2],           0, 100000),
+    SCENARIO_KEY("reg_open_at_4",             reg_open_at[3],            1, 100000),
+    SCENARIO_KEY("reg_close_at_4",            reg_close_at[3],           0, 100000),
+    SCENARIO_KEY("reg_open_at_5",             reg_open_at[4],            1, 100000),
+    SCENARIO_KEY("reg_close_at_5",            reg_close_at[4],           0, 100000),
+    SCENARIO_KEY("reg_open_at_6",             reg_open_at[5],            1, 100000),
+    SCENARIO_KEY("reg_close_at_6",            reg_close_at[5],           0, 100000),
+    SCENARIO_KEY("reg_open_at_7",             reg_open_at[6],            1, 100000),
+    SCENARIO_KEY("reg_close_at_7",            reg_close_at[6],           0, 100000),
+    SCENARIO_KEY("reg_open_at_8",             reg_open_at[7],            1, 100000),
+    SCENARIO_KEY("reg_close_at_8",            reg_close_at[7],           0, 100000),
+
+    SCENARIO_KEY("patient_gen_min_ms",        gen_min_ms,                1, SCENARIO_MAX_MS),
+    SCENARIO_KEY("patient_gen_max_ms",        gen_max_ms,                1, SCENARIO_MAX_MS),
+    SCENARIO_KEY("registration_min_ms",       registration_min_ms,       0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("registration_max_ms",       registration_max_ms,       0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("registration_known_min_ms", registration_known_min_ms, 0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("registration_known_max_ms", registration_known_max_ms, 0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("triage_min_ms",             triage_min_ms,             0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("triage_max_ms",             triage_max_ms,             0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("treatment_min_ms",          treatment_min_ms,          0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("treatment_max_ms",          treatment_max_ms,          0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("doctor_break_min_ms",       break_min_ms,              0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("doctor_break_max_ms",       break_max_ms,              0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("break_interval_ms",         break_interval_ms,         0, SCENARIO_MAX_MS),
+    SCENARIO_KEY("break_max_defer_ms",        break_max_defer_ms,        0, SCENARIO_MAX_MS),
+
+    SCENARIO_KEY("registry_enabled",          registry_enabled,          0, 1),
+    SCENARIO_KEY("triage_mode",               triage_mode,               TRIAGE_RANDOM, TRIAGE_NEWS),
+    SCENARIO_KEY("triage_red_pm",             triage_pm[0],              0, 1000000),
+    SCENARIO_KEY("triage_yellow_pm",          triage_pm[1],              0, 1000000),
+    SCENARIO_KEY("triage_green_pm",           triage_pm[2],              0, 1000000),
+    SCENARIO_KEY("triage_home_pm",            triage_pm[3],              0, 1000000),
+    SCENARIO_KEY("spec_kardiolog_pm",         spec_pm[0],                0, 1000000),
+    SCENARIO_KEY("spec_neurolog_pm",          spec_pm[1],                0, 1000000),
+    SCENARIO_KEY("spec_okulista_pm",          spec_pm[2],                0, 1000000),
+    SCENARIO_KEY("spec_laryngolog_pm",        spec_pm[3],                0, 1000000),
+    SCENARIO_KEY("spec_chirurg_pm",           spec_pm[4],                0, 1000000),
+    SCENARIO_KEY("outcome_home_pm",           outcome_pm[0],             0, 1000000),
+    SCENARIO_KEY("outcome_ward_pm",           outcome_pm[1],             0, 1000000),
+    SCENARIO_KEY("outcome_other_pm",          outcome_pm[2],             0, 1000000),
+
+    SCENARIO_KEY("doctor_enabled_kardiolog",  doctor_enabled[DOCTOR_KARDIOLOG],  0, 1),
+    SCENARIO_KEY("doctor_enabled_neurolog",   doctor_enabled[DOCTOR_NEUROLOG],   0, 1),
+    SCENARIO_KEY("doctor_enabled_okulista",   doctor_enabled[DOCTOR_OKULISTA],   0, 1),
+    SCENARIO_KEY("doctor_enabled_laryngolog", doctor_enabled[DOCTOR_LARYNGOLOG], 0, 1),
+    SCENARIO_KEY("doctor_enabled_chirurg",    doctor_enabled[DOCTOR_CHIRURG],    0, 1),
+    SCENARIO_KEY("doctor_enabled_pediatra",   doctor_enabled[DOCTOR_PEDIATRA],   0, 1),
+    SCENARIO_KEY("specialist_sched",          specialist_sched,                  SCHED_STRICT_PRIORITY, SCHED_EDF),
+    SCENARIO_KEY("deadline_red_ms",           deadline_ms[COLOR_RED],            1, SCENARIO_MAX_MS),
+    SCENARIO_KEY("deadline_yellow_ms",        deadline_ms[COLOR_YELLOW],         1, SCENARIO_MAX_MS),
+    SCENARIO_KEY("deadline_green_ms",         deadline_ms[COLOR_GREEN],          1, SCENARIO_MAX_MS),
+    SCENARIO_KEY("preempt_red",               preempt_red,                       0, 1),
+    SCENARIO_KEY("work_stealing",             work_stealing,                     0, 1),
+    SCENARIO_KEY("steal_mask_kardiolog",      steal_mask[DOCTOR_KARDIOLOG],      0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("steal_mask_neurolog",       steal_mask[DOCTOR_NEUROLOG],       0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("steal_mask_okulista",       steal_mask[DOCTOR_OKULISTA],       0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("steal_mask_laryngolog",     steal_mask[DOCTOR_LARYNGOLOG],     0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("steal_mask_chirurg",        steal_mask[DOCTOR_CHIRURG],        0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("steal_mask_pediatra",       steal_mask[DOCTOR_PEDIATRA],       0, (1 << DOCTOR_COUNT) - 1),
+    SCENARIO_KEY("overload_policy",           overload_policy,                   OVERLOAD_NONE, OVERLOAD_BACKPRESSURE),
+    SCENARIO_KEY("backlog_limit",             backlog_limit,                     1, 100000),
+    SCENARIO_KEY("autoscale_max_staff",       autoscale_max_staff,               0, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_poz",          doctor_staff[DOCTOR_POZ],          1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_kardiolog",    doctor_staff[DOCTOR_KARDIOLOG],    1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_neurolog",     doctor_staff[DOCTOR_NEUROLOG],     1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_okulista",     doctor_staff[DOCTOR_OKULISTA],     1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_laryngolog",   doctor_staff[DOCTOR_LARYNGOLOG],   1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_chirurg",      doctor_staff[DOCTOR_CHIRURG],      1, DOCTOR_MAX_INSTANCES),
+    SCENARIO_KEY("doctor_staff_pediatra",     doctor_staff[DOCTOR_PEDIATRA],     1, DOCTOR_MAX_INSTANCES),
+
+    SCENARIO_KEY("ward_beds_kardiolog",       ward_beds[DOCTOR_KARDIOLOG],       0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_beds_neurolog",        ward_beds[DOCTOR_NEUROLOG],        0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_beds_okulista",        ward_beds[DOCTOR_OKULISTA],        0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_beds_laryngolog",      ward_beds[DOCTOR_LARYNGOLOG],      0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_beds_chirurg",         ward_beds[DOCTOR_CHIRURG],         0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_beds_pediatra",        ward_beds[DOCTOR_PEDIATRA],        0, WARD_MAX_BEDS),
+    SCENARIO_KEY("ward_los_kardiolog_ms",     ward_los_ms[DOCTOR_KARDIOLOG],     1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_los_neurolog_ms",      ward_los_ms[DOCTOR_NEUROLOG],      1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_los_okulista_ms",      ward_los_ms[DOCTOR_OKULISTA],      1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_los_laryngolog_ms",    ward_los_ms[DOCTOR_LARYNGOLOG],    1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_los_chirurg_ms",       ward_los_ms[DOCTOR_CHIRURG],       1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_los_pediatra_ms",      ward_los_ms[DOCTOR_PEDIATRA],      1, SCENARIO_MAX_LOS_MS),
+    SCENARIO_KEY("ward_initial_pct",          ward_initial_pct,                  0, 100),
+};
+
+#undef SCENARIO_KEY
+
+// ============================================================================
+// WALIDACJA I WCZYTYWANIE
+// ============================================================================
+
+/// Sprawdza spójność po wczytaniu; opis błędu do err
+inline bool scenarioValidate(const ScenarioParams& p, char* err, size_t err_len) {
+    const struct { const char* name; int lo, hi; } ranges[] = {
+        { "patient_gen", p.gen_min_ms, p.gen_max_ms },
+        { "registration", p.registration_min_ms, p.registration_max_ms },
+        { "registration_known", p.registration_known_min_ms, p.registration_known_max_ms },
+        { "triage", p.triage_min_ms, p.triage_max_ms },
+        { "treatment", p.treatment_min_ms, p.treatment_max_ms },
+        { "doctor_break", p.break_min_ms, p.break_max_ms },
+    };
+    for (const auto& r : ranges) {
+        if (r.hi < r.lo) {
+            snprintf(err, err_len, "%s_max_ms < %s_min_ms", r.name, r.name);
+            return false;
+        }
+    }
+    if (p.registration_min_ms + p.registration_max_ms == 0) {
+        snprintf(err, err_len, "czas rejestracji nie może być zerowy (sterowanie okienkami)");
+        return false;
+    }
+    // Jak regThresholdsValid(), ale tylko dla okienek 2..M tego scenariusza
+    for (int i = 1; i < p.reg_windows; i++) {
+        if (p.reg_close_at[i] >= p.reg_open_at[i]) {
+            snprintf(err, err_len, "okienko %d: próg zamknięcia (%d) musi być < progu otwarcia (%d)",
+                     i + 1, p.reg_close_at[i], p.reg_open_at[i]);
+            return false;
+        }
+        if (i > 1 && p.reg_open_at[i] < p.reg_open_at[i - 1]) {
+            snprintf(err, err_len, "okienko %d: próg otwarcia (%d) mniejszy niż okienka %d (%d)",
+                     i + 1, p.reg_open_at[i], i, p.reg_open_at[i - 1]);
+            return false;
+        }
+    }
+    if (p.preempt_red && p.specialist_sched == SCHED_EDF) {
+        // W EDF czołem kolejki bywa starszy zielony z wcześniejszym terminem — nie ma
+        // komu oddać miejsca bez zwrotu do własnej (być może pełnej) kolejki
+        snprintf(err, err_len, "preempt_red = 1 wymaga specialist_sched = 0 (ścisły priorytet)");
+        return false;
+    }
+    for (int d = DOCTOR_KARDIOLOG; d <= DOCTOR_CHIRURG; d++) {
+        if (!p.doctor_enabled[d] && p.spec_pm[d - DOCTOR_KARDIOLOG] > 0) {
+            snprintf(err, err_len, "spec_%s_pm > 0 przy wyłączonym lekarzu", getDoctorName((DoctorType)d));
+            return false;
+        }
+    }
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) {
+        if (!stealMaskValid(d, p.steal_mask[d])) {
+            snprintf(err, err_len, "steal_mask_%s: bity 1-6 (specjaliści), pediatra tylko u pediatry",
+                     getDoctorName((DoctorType)d));
+            return false;
+        }
+    }
+    int beds = 0;
+    for (int d = DOCTOR_KARDIOLOG; d < DOCTOR_COUNT; d++) beds += p.ward_beds[d];
+    if (beds > WARD_MAX_BEDS) {
+        snprintf(err, err_len, "suma ward_beds_* = %d > %d (WARD_MAX_BEDS)", beds, WARD_MAX_BEDS);
+        return false;
+    }
+    if constexpr (CHILDREN_MODE != NO_CHILDREN) {
+        if (!p.doctor_enabled[DOCTOR_PEDIATRA]) {
+            snprintf(err, err_len, "pediatra wyłączony, a CHILDREN_MODE dopuszcza dzieci");
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Wczytuje plik scenariusza do sc (nadpisuje tylko podane klucze) i buduje tablice aliasów
+ * @return false przy błędzie — komunikat z numerem linii już na stderr
+ */
+inline bool loadScenario(const char* path, ScenarioConfig& sc) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Błąd: nie można otworzyć scenariusza '%s': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    char line[256];
+    int lineno = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char* hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char key[64];
+        char value[64];
+        int fields = sscanf(line, " %63[a-z_0-9] = %63s", key, value);
+        if (fields <= 0) {
+            char rest[2];
+            if (sscanf(line, " %1s", rest) == 1) {  // Niepusta linia, której nie da się odczytać
+                fprintf(stderr, "Błąd: %s:%d: oczekiwano \"klucz = wartość\"\n", path, lineno);
+                ok = false;
+            }
+            continue;
+        }
+        if (fields != 2) {
+            fprintf(stderr, "Błąd: %s:%d: brak wartości dla '%s'\n", path, lineno, key);
+            ok = false;
+            break;
+        }
+
+        const ScenarioKey* k = nullptr;
+        for (const ScenarioKey& cand : SCENARIO_KEYS) {
+            if (strcmp(cand.name, key) == 0) { k = &cand; break; }
+        }
+        if (!k) {
+            fprintf(stderr, "Błąd: %s:%d: nieznany klucz '%s'\n", path, lineno, key);
+            ok = false;
+            break;
+        }
+
+        char* end = nullptr;
+        long v = strtol(value, &end, 10);
+        if (*end != '\0' || v < k->min || v > k->max) {
+            fprintf(stderr, "Błąd: %s:%d: %s musi być liczbą z zakresu %d-%d (podano: '%s')\n",
+                    path, lineno, key, k->min, k->max, value);
+            ok = false;
+            break;
+        }
+        *(int*)((char*)&sc.p + k->offset) = (int)v;
+    }
+    fclose(f);
+    if (!ok) return false;
+
+    char err[160];
+    if (!scenarioValidate(sc.p, err, sizeof(err))) {
+        fprintf(stderr, "Błąd: %s: %s\n", path, err);
+        return false;
+    }
+    if (!scenarioBuildTables(sc)) {
+        fprintf(stderr, "Błąd: %s: suma wag triażu, specjalistów i wyników musi być > 0\n", path);
+        return false;
+    }
+    return true;
+}
+
+#endif // SOR_SCENARIO_HPP
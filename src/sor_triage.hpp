@@ -0,0 +1,139 @@
+/**
+ * @file sor_triage.hpp
+ * @brief Silnik triażu NEWS2 (TRIAGE_MODE = TRIAGE_NEWS) — parametry życiowe i punktacja partii
+ *
+ * Ukryta ostrość (wg wag triage_*_pm) → syntetyczne parametry życiowe → punktacja NEWS2
+ * (National Early Warning Score 2) → kolor i kierunek. Partia pacjentów czekających na
+ * POZ jest trzymana jako struktura tablic (SoA): każdy parametr w osobnej tablicy, a
+ * punktacja to proste pętle bez rozgałęzień po kolejnych pacjentach — przy kompilacji
+ * z optymalizacją (-O2/-O3) kompilator zamienia je na instrukcje wektorowe.
+ */
+
+#ifndef SOR_TRIAGE_HPP
+#define SOR_TRIAGE_HPP
+
+#include "sor_common.hpp"
+#include <cmath>
+
+// ============================================================================
+// PARAMETRY ŻYCIOWE (SoA)
+// ============================================================================
+
+struct VitalsBatch {
+    int n;
+    float resp_rate[TRIAGE_BATCH_MAX];   // Oddechy / min
+    float spo2[TRIAGE_BATCH_MAX];        // Saturacja [%]
+    float systolic[TRIAGE_BATCH_MAX];    // Ciśnienie skurczowe [mmHg]
+    float heart_rate[TRIAGE_BATCH_MAX];  // Tętno / min
+    float temp[TRIAGE_BATCH_MAX];        // Temperatura [°C]
+    float gcs[TRIAGE_BATCH_MAX];         // Skala Glasgow 3-15
+
+    // Wynik punktacji
+    int score[TRIAGE_BATCH_MAX];         // Suma NEWS2
+    int max_param[TRIAGE_BATCH_MAX];     // Najwyższa punktacja pojedynczego parametru
+    int cardio[TRIAGE_BATCH_MAX];        // Punkty krążenia (tętno + ciśnienie)
+    int neuro[TRIAGE_BATCH_MAX];         // Punkty świadomości (GCS)
+};
+
+/// Rozkład normalny (Box–Muller) ze strumienia bieżącego RngScope
+inline float randomNormal(float mean, float sd) {
+    double u1 = randomUniform();
+    double u2 = randomUniform();
+    return mean + sd * (float)(sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+/// Średnia i odchylenie parametrów wg ukrytej ostrości (indeks = TriageColor, [0] nieużywany)
+struct VitalsProfile {
+    float rr, rr_sd, spo2, spo2_sd, sbp, sbp_sd, hr, hr_sd, temp, temp_sd;
+    float gcs_drop_p;   // Prawdopodobieństwo obniżonej świadomości
+};
+inline constexpr VitalsProfile VITALS_PROFILE[] = {
+    {},
+    { 27.0f, 5.0f, 89.0f, 4.0f,  92.0f, 18.0f, 122.0f, 20.0f, 38.3f, 1.0f, 0.40f },  // czerwony
+    { 21.0f, 3.0f, 94.0f, 2.0f, 108.0f, 15.0f, 102.0f, 12.0f, 37.9f, 0.7f, 0.08f },  // żółty
+    { 16.0f, 2.5f, 97.0f, 1.5f, 125.0f, 14.0f,  82.0f, 12.0f, 37.0f, 0.5f, 0.01f },  // zielony
+    { 14.0f, 2.0f, 98.0f, 1.0f, 122.0f, 10.0f,  72.0f,  8.0f, 36.7f, 0.3f, 0.00f },  // do domu
+};
+
+/// Losuje parametry pacjenta i dopisuje je do partii (wołać w RngScope pacjenta)
+inline void generateVitals(VitalsBatch& b, TriageColor acuity) {
+    const VitalsProfile& p = VITALS_PROFILE[acuity];
+    int i = b.n++;
+    b.resp_rate[i] = fmaxf(4.0f, randomNormal(p.rr, p.rr_sd));
+    b.spo2[i] = fminf(100.0f, randomNormal(p.spo2, p.spo2_sd));
+    b.systolic[i] = fmaxf(50.0f, randomNormal(p.sbp, p.sbp_sd));
+    b.heart_rate[i] = fmaxf(30.0f, randomNormal(p.hr, p.hr_sd));
+    b.temp[i] = randomNormal(p.temp, p.temp_sd);
+    b.gcs[i] = randomUniform() < p.gcs_drop_p ? (float)randomInt(6, 14) : 15.0f;
+}
+
+// ============================================================================
+// PUNKTACJA NEWS2 — pętle po partii, progi jako sumy porównań (bez rozgałęzień)
+// ============================================================================
+
+inline void scoreVitals(VitalsBatch& b) {
+    const int n = b.n;
+    int rr[TRIAGE_BATCH_MAX], sp[TRIAGE_BATCH_MAX], bp[TRIAGE_BATCH_MAX];
+    int hr[TRIAGE_BATCH_MAX], tp[TRIAGE_BATCH_MAX], cn[TRIAGE_BATCH_MAX];
+
+    // Oddechy: <=8 → 3, 9-11 → 1, 12-20 → 0, 21-24 → 2, >=25 → 3
+    for (int i = 0; i < n; i++) {
+        float x = b.resp_rate[i];
+        rr[i] = (x < 12.0f) + 2 * (x < 9.0f) + 2 * (x >= 21.0f) + (x >= 25.0f);
+    }
+    // SpO2 (skala 1): <=91 → 3, 92-93 → 2, 94-95 → 1
+    for (int i = 0; i < n; i++) {
+        float x = b.spo2[i];
+        sp[i] = (x < 96.0f) + (x < 94.0f) + (x < 92.0f);
+    }
+    // Skurczowe: <=90 → 3, 91-100 → 2, 101-110 → 1, >=220 → 3
+    for (int i = 0; i < n; i++) {
+        float x = b.systolic[i];
+        bp[i] = (x < 111.0f) + (x < 101.0f) + (x < 91.0f) + 3 * (x >= 220.0f);
+    }
+    // Tętno: <=40 → 3, 41-50 → 1, 91-110 → 1, 111-130 → 2, >=131 → 3
+    for (int i = 0; i < n; i++) {
+        float x = b.heart_rate[i];
+        hr[i] = (x < 51.0f) + 2 * (x < 41.0f) + (x >= 91.0f) + (x >= 111.0f) + (x >= 131.0f);
+    }
+    // Temperatura: <=35 → 3, 35.1-36 → 1, 38.1-39 → 1, >=39.1 → 2
+    for (int i = 0; i < n; i++) {
+        float x = b.temp[i];
+        tp[i] = (x <= 36.0f) + 2 * (x <= 35.0f) + (x > 38.0f) + (x > 39.0f);
+    }
+    // Świadomość: każde obniżenie GCS → 3
+    for (int i = 0; i < n; i++)
+        cn[i] = 3 * (b.gcs[i] < 15.0f);
+
+    for (int i = 0; i < n; i++) {
+        b.score[i] = rr[i] + sp[i] + bp[i] + hr[i] + tp[i] + cn[i];
+        int m = rr[i] > sp[i] ? rr[i] : sp[i];
+        m = m > bp[i] ? m : bp[i];
+        m = m > hr[i] ? m : hr[i];
+        m = m > tp[i] ? m : tp[i];
+        b.max_param[i] = m > cn[i] ? m : cn[i];
+        b.cardio[i] = hr[i] + bp[i];
+        b.neuro[i] = cn[i];
+    }
+}
+
+/**
+ * @brief Kolor z NEWS2: >=7 czerwony; 5-6 albo pojedynczy parametr za 3 — żółty;
+ *        1-4 zielony; 0 — do domu, o ile scenariusz odsyła z triażu (triage_home_pm > 0)
+ */
+inline TriageColor newsColor(const VitalsBatch& b, int i) {
+    if (b.score[i] >= 7) return COLOR_RED;
+    if (b.score[i] >= 5 || b.max_param[i] >= 3) return COLOR_YELLOW;
+    if (b.score[i] == 0 && g_scenario.p.triage_pm[3] > 0) return COLOR_SENT_HOME;
+    return COLOR_GREEN;
+}
+
+/// Kierunek z parametrów: zaburzenia świadomości → neurolog, krążenia (>= 3 pkt) → kardiolog
+inline DoctorType newsSpecialist(const VitalsBatch& b, int i, int age, DoctorType fallback) {
+    if (age < 18) return DOCTOR_PEDIATRA;
+    if (b.neuro[i] > 0 && g_scenario.p.doctor_enabled[DOCTOR_NEUROLOG]) return DOCTOR_NEUROLOG;
+    if (b.cardio[i] >= 3 && g_scenario.p.doctor_enabled[DOCTOR_KARDIOLOG]) return DOCTOR_KARDIOLOG;
+    return fallback;
+}
+
+#endif // SOR_TRIAGE_HPP
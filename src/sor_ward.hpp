@@ -0,0 +1,81 @@
+/**
+ * @file sor_ward.hpp
+ * @brief Oddziały szpitalne (ward_beds_*) — łóżka, kopiec terminów wypisu, czas pobytu
+ *
+ * Wolne łóżka oddziału to semafor SEM_WARD_<oddział>: pacjent z wynikiem "oddział" czeka
+ * na nim w SOR (boarding), a po przyjęciu dopisuje termin wypisu do kopca w SharedState.
+ * Semafor SysV nie gwarantuje kolejności budzenia, więc czekający biorą bilet oddziału
+ * i na semaforze stoi tylko czoło kolejki FIFO (order_board_msgid, jak kolejka wyjścia).
+ * Dyrektor co WARD_TICK_MS zdejmuje z kopca terminy, które minęły, i oddaje łóżka (V).
+ * Zajęte łóżko to tylko wpis w kopcu — tysiące łóżek nie kosztują procesów ani timerów.
+ */
+
+#ifndef SOR_WARD_HPP
+#define SOR_WARD_HPP
+
+#include "sor_common.hpp"
+#include <cmath>
+
+inline const char* getWardName(DoctorType type) {
+    static const char* const names[DOCTOR_COUNT] = {
+        "-", "kardiologia", "neurologia", "okulistyka", "laryngologia", "chirurgia", "pediatria"
+    };
+    return (type >= DOCTOR_KARDIOLOG && type <= DOCTOR_PEDIATRA) ? names[type] : "nieznany";
+}
+
+/// Czy oddział ma skończoną liczbę łóżek (0 = przyjęcie natychmiast, bez boardingu)
+inline bool wardLimited(DoctorType dept) {
+    return dept >= DOCTOR_KARDIOLOG && dept <= DOCTOR_PEDIATRA && g_scenario.p.ward_beds[dept] > 0;
+}
+
+/// mtype biletu boardingu: jedna kolejka porządkująca, bilety oddziałów przeplecione
+/// co DOCTOR_COUNT (następny bilet oddziału = mtype + DOCTOR_COUNT)
+inline long wardBoardMtype(DoctorType dept, long ticket) {
+    return ticket * DOCTOR_COUNT + dept;
+}
+
+/// Pobyt ~ Exp(ward_los_ms) w czasie symulacji → ns zegara ściennego (wołać w RngScope)
+inline long long randomWardStayNs(DoctorType dept) {
+    double ms = -log(randomUniform()) * g_scenario.p.ward_los_ms[dept];
+    return (long long)(ms * 1e6 / g_time_scale);
+}
+
+// ============================================================================
+// KOPIEC TERMINÓW WYPISU (wszystkie oddziały, pod SEM_SHM_MUTEX)
+// ============================================================================
+
+/// Dopisuje zajęte łóżko — rozmiar ograniczony sumą łóżek (każdy wpis po P na SEM_WARD_*)
+inline void wardHeapPush(SharedState* s, WardStay stay) {
+    int i = s->ward_heap_size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (s->ward_heap[parent].due_ns <= stay.due_ns) break;
+        s->ward_heap[i] = s->ward_heap[parent];
+        i = parent;
+    }
+    s->ward_heap[i] = stay;
+}
+
+/// Zdejmuje najwcześniejszy termin (kopiec niepusty)
+inline WardStay wardHeapPop(SharedState* s) {
+    WardStay top = s->ward_heap[0];
+    WardStay last = s->ward_heap[--s->ward_heap_size];
+    int n = s->ward_heap_size, i = 0;
+    while (2 * i + 1 < n) {
+        int child = 2 * i + 1;
+        if (child + 1 < n && s->ward_heap[child + 1].due_ns < s->ward_heap[child].due_ns) child++;
+        if (last.due_ns <= s->ward_heap[child].due_ns) break;
+        s->ward_heap[i] = s->ward_heap[child];
+        i = child;
+    }
+    if (n > 0) s->ward_heap[i] = last;
+    return top;
+}
+
+/// Zajmuje łóżko na oddziale: termin wypisu do kopca i liczniki zajętości
+inline void wardOccupy(SharedState* s, DoctorType dept, long long due_ns) {
+    wardHeapPush(s, WardStay{ due_ns, dept });
+    if (++s->ward_occupied[dept] > s->ward_peak[dept]) s->ward_peak[dept] = s->ward_occupied[dept];
+}
+
+#endif // SOR_WARD_HPP